@@ -5,9 +5,51 @@ extern "C"
     #ifndef BTEA_H
     #define BTEA_H
 
+    #include <stddef.h>
     #include <stdint.h>
 
     int btea( uint32_t *v, int32_t n, const uint32_t k[4] );
+
+    /* 6 + 52 / n rounds for the 3 word Device C payload */
+    #define BTEA3_ROUNDS 23
+
+    /* Everything a 3 word encrypt needs from the key, worked out once:
+       the running sum of each round and the key word each of its three
+       steps mixes in. */
+    typedef struct btea3_schedule
+    {
+        uint32_t sum[ BTEA3_ROUNDS ];
+        uint32_t key[ BTEA3_ROUNDS ][3];
+    } btea3_schedule;
+
+    void btea3_schedule_init( btea3_schedule * ks, const uint32_t k[4] );
+
+    /* Same result as btea( v, 3, k ), for the fixed size Device C payload */
+    void btea3_encrypt( uint32_t v[3], const uint32_t k[4] );
+    void btea3_encrypt_scheduled( uint32_t v[3], const btea3_schedule * ks );
+
+    /* Encrypt count 3 word payloads with one key. Payloads start stride
+       bytes apart (0 for a plain uint32_t[count][3] array) and need not be
+       aligned, so a run of wire frames can be done in place. */
+    void btea3_encrypt_batch( void * v, size_t count, size_t stride, const uint32_t k[4] );
+    void btea3_encrypt_batch_scheduled( void * v, size_t count, size_t stride, const btea3_schedule * ks );
+
+    /* Vector kernels for btea3_encrypt_batch(), picked at first use from
+       what the CPU supports. All of them give the same bytes. */
+    enum btea3_impl
+    {
+        BTEA3_SCALAR,
+        BTEA3_SSE2,
+        BTEA3_AVX2,
+        BTEA3_NUM_IMPLS
+    };
+
+    int btea3_impl_supported( enum btea3_impl impl );
+    int btea3_set_impl( enum btea3_impl impl );
+    enum btea3_impl btea3_get_impl( void );
+    const char * btea3_impl_name( enum btea3_impl impl );
+
+    void btea3_encrypt_batch_scalar( void * v, size_t count, size_t stride, const btea3_schedule * ks );
     #endif
     #ifdef __cplusplus
 }
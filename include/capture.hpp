@@ -0,0 +1,85 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Byte stream capture file:
+ *   "LCAP" and a uint32 version, then one record per chunk of traffic:
+ *   uint32 usecs since the previous record, uint8 direction, uint16
+ *   length and the bytes themselves, all little endian. A gap too long
+ *   for the delta is carried by empty records.
+ */
+#define CAPTURE_MAGIC   "LCAP"
+#define CAPTURE_VERSION 1
+
+enum capture_dir
+{
+    CAPTURE_TX = 0,
+    CAPTURE_RX = 1
+};
+
+struct capture_record
+{
+    uint64_t             time;      /* usecs since the capture started */
+    capture_dir          dir;
+    std::vector<uint8_t> data;
+};
+
+class capture_writer
+{
+    public:
+        capture_writer();
+        ~capture_writer();
+
+        bool open( const std::string & filename, uint64_t now );
+        void close();
+        bool is_open() const;
+        void record( capture_dir dir, const uint8_t * data, std::size_t size, uint64_t now );
+
+    private:
+        FILE   * out;
+        uint64_t last;
+};
+
+class capture_reader
+{
+    public:
+        capture_reader();
+        ~capture_reader();
+
+        bool open( const std::string & filename );
+        void close();
+        bool next( capture_record & rec );
+
+    private:
+        FILE   * in;
+        uint64_t time;
+};
+#endif
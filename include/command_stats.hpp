@@ -0,0 +1,80 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef COMMAND_STATS_HPP
+#define COMMAND_STATS_HPP
+#include <stdint.h>
+#include <ostream>
+
+/* HDR style buckets: below 2^HISTOGRAM_SUB_BITS ns each value has its
+   own, and every octave above is split in 2^HISTOGRAM_SUB_BITS linear
+   steps, so a bucket is never wider than 1/16 of the values in it.
+   Everything from 2^HISTOGRAM_OCTAVES ns (~34 s) up shares the last. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB      ( 1 << HISTOGRAM_SUB_BITS )
+#define HISTOGRAM_OCTAVES  35
+#define HISTOGRAM_BUCKETS  ( ( HISTOGRAM_OCTAVES - HISTOGRAM_SUB_BITS + 1 ) * HISTOGRAM_SUB )
+
+struct latency_histogram
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[ HISTOGRAM_BUCKETS ];
+
+    void     reset();
+    void     add( uint64_t ns );
+    void     merge( const latency_histogram & other );
+    uint64_t mean() const;
+    uint64_t percentile( double p ) const;
+};
+
+enum stat_type
+{
+    STAT_MOVE,
+    STAT_LINE,
+    STAT_CURVE,
+    STAT_START,
+    STAT_STOP,
+    NUM_STAT_TYPES
+};
+
+struct command_stats
+{
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t timeouts;
+    uint64_t dropped;       /* never acked, timed out or behind a timeout */
+    latency_histogram encode;
+    latency_histogram write;
+    latency_histogram ack;
+
+    void reset();
+};
+
+uint64_t stats_clock();
+const char * stat_type_name( stat_type type );
+void print_stats( std::ostream & out, const command_stats stats[ NUM_STAT_TYPES ] );
+#endif
@@ -0,0 +1,78 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef CUTBIN_HPP
+#define CUTBIN_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "types.h"
+#include "lmc_command.hpp"
+#include "command_stats.hpp"
+#include "device_c.hpp"
+#include "device_recorder.hpp"
+
+namespace Device
+{
+    /*
+     * A compiled job: the encrypted frames exactly as they go on the
+     * wire, so sending it takes no parsing, geometry or encryption. The
+     * file is this header, then the frames, then one byte per frame with
+     * its stat_type.
+     */
+    struct cutbin_header
+    {
+        char     profile[16];       /* device it was compiled for */
+        uint32_t units_per_inch;
+        uint32_t link_rate;         /* the estimate assumed this */
+        uint64_t key_ids[3];        /* C::key_id() of move, line, curve */
+        uint64_t source_hash;       /* fnv1a() of the file compiled */
+        ixy      min;               /* bounding box, device units */
+        ixy      max;
+        uint32_t estimated_ms;
+        uint32_t commands;
+        uint32_t frames;
+    };
+
+    static const std::size_t CUTBIN_HEADER_SIZE = 96;
+    /* Head speed the estimate assumes */
+    static const double CUTBIN_INCHES_PER_SEC = 2.0;
+
+    /* Frontends compile instead of cutting when given such a file name
+       in place of the port */
+    bool is_cutbin( const std::string & file );
+    /* fnv1a() of a whole file, 0 if it cannot be read */
+    uint64_t hash_file( const std::string & file );
+
+    /* Encode everything recorder holds with device's keys and write it
+       to file, printing a line that sums it up */
+    bool compile_cutbin( const std::string & file, C & device, const Recorder & recorder, uint64_t source_hash );
+    bool save_cutbin( const std::string & file, const cutbin_header & header, const C::encoded_job & job );
+    /* Checks data holds a whole .cutbin and fills in header; the frames
+       start CUTBIN_HEADER_SIZE bytes in, their types right after */
+    bool parse_cutbin( const uint8_t * data, std::size_t size, cutbin_header & header );
+}
+#endif
@@ -27,11 +27,41 @@
 
 #include "types.h"
 #include <string>
+#include <cstddef>
 
 typedef unsigned long _DWORD;
 
 namespace Device
 {
+    enum command_type
+    {
+        CMD_MOVE,
+        CMD_CUT,
+        CMD_CURVE
+    };
+
+    /* One step of a toolpath: moves and cuts use pt[0], curves all four */
+    struct command
+    {
+        command_type type;
+        xy pt[4];
+    };
+
+    /* The same with its points already in device units */
+    struct unit_command
+    {
+        command_type type;
+        ixy pt[4];
+    };
+
+    /* Inches to whole device units and back. Rounds to the nearest
+       unit, halves away from zero, clamped to what int32 holds, with NaN
+       and infinities as 0; every quantiser in the library goes through
+       here so they all agree. */
+    int32_t round_units( double units );
+    ixy to_units( const xy &pt, int units_per_inch );
+    xy from_units( const ixy &pt, int units_per_inch );
+
     class Generic
     {
         public:
@@ -43,6 +73,13 @@ namespace Device
             virtual bool move_to(const xy &aPoint) = 0;
             virtual bool cut_to(const xy &aPoint) = 0;
             virtual bool curve_to(const xy &p0, const xy &p1, const xy &p2, const xy &p3) = 0;
+            virtual std::size_t submit( const command * cmds, std::size_t count );
+            /* Device units per inch for a device that works on a fixed
+               grid, 0 for one that takes inches as they come */
+            virtual inline int get_units_per_inch() { return 0; };
+            /* A toolpath already on that grid, for callers that quantise
+               it themselves; fails at once on a device without one */
+            virtual std::size_t submit_units( const unit_command * cmds, std::size_t count );
             virtual bool start() = 0;
             virtual bool stop() = 0;
             inline bool is_connected() { return false; }
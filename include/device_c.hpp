@@ -27,15 +27,32 @@
 
 #include <stdint.h>
 #include <cstring>
+#include <vector>
+#include <pthread.h>
 #include "device.hpp"
 #include "types.h"
 #include "serial_port.hpp"
+#include "transport.hpp"
+#include "lmc_command.hpp"
+#include "btea.h"
+#include "command_stats.hpp"
+#include "frame_cache.hpp"
+#include "spsc_ring.hpp"
+#include "link_rate.hpp"
+#include "realtime.hpp"
 
 namespace Device
 {
     class C : public Device::Generic
     {
         public:
+            /* Most commands allowed in flight at once */
+            static const int MAX_WINDOW = 16;
+            /* Default number of frames queued for the I/O thread */
+            static const std::size_t IO_RING_SIZE = 256;
+            /* Device units per inch */
+            static const int UNITS_PER_INCH = 404;
+
             C();
             C( const std::string filename );
             ~C();
@@ -43,26 +60,220 @@ namespace Device
             /* virtual */ bool move_to( const xy &aPoint );
             /* virtual */ bool cut_to( const xy &aPoint );
             /* virtual */ bool curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 );
+            /* virtual */ std::size_t submit( const command * cmds, std::size_t count );
+
+            /* Inches to device units, rounded by Device::round_units().
+               Every inch based call goes through this once; the _units
+               calls below skip it and do integer work only, so equal
+               points always make equal frames. */
+            static ixy to_units( const xy &pt );
+            static unit_command to_units( const command &cmd );
+            static xy from_units( const ixy &pt );
+            bool move_to_units( const ixy &pt );
+            bool cut_to_units( const ixy &pt );
+            bool curve_to_units( const ixy &p0, const ixy &p1, const ixy &p2, const ixy &p3 );
+            /* virtual */ std::size_t submit_units( const unit_command * cmds, std::size_t count );
+            /* virtual */ inline int get_units_per_inch()
+            {
+                return UNITS_PER_INCH;
+            }
+            /* Where the head was last sent, in device units */
+            inline ixy get_position_units() const
+            {
+                return m_position;
+            }
             /* virtual */ bool start();
             /* virtual */ bool stop();
             /* virtual */ xy   get_dimensions();
+            /* Encode one point of a command into a frame without sending
+               it, for callers that run the port themselves (port_loop) */
+            void encode_frame( const xy &pt, command_type type, lmc_command &l );
+            void encode_frame( const ixy &pt, command_type type, lmc_command &l );
+
+            /* A toolpath turned into wire frames ahead of time, so that
+               sending it is nothing but I/O. Command i owns frames
+               ends[ i - 1 ] up to ends[i] and leaves the head at
+               positions[i]. */
+            struct encoded_job
+            {
+                std::vector<lmc_command> frames;
+                std::vector<stat_type>   types;
+                std::vector<std::size_t> ends;
+                std::vector<ixy>         positions;
+            };
+            /* Encode a whole toolpath into job, split in chunks across
+               threads workers (0 for one per CPU). Stops at the first
+               command it cannot encode; returns how many it did. */
+            std::size_t encode_job( const command * cmds, std::size_t count, encoded_job & job, int threads = 0 );
+            std::size_t encode_job( const unit_command * cmds, std::size_t count, encoded_job & job, int threads = 0 );
+            /* Stream job's commands from first on, returning how many
+               were sent; the head position follows the last of them */
+            std::size_t send_job( const encoded_job & job, std::size_t first = 0 );
+            /* Stream frames encoded elsewhere, such as a .cutbin file,
+               each tagged with the type it was encrypted as. Returns how
+               many were sent; the head position is left alone. */
+            std::size_t send_frames( const lmc_command * l, const stat_type * types, std::size_t count );
             inline void set_move_key( ckey_type k )
             {
-                memcpy( m_move_key, k, sizeof(ckey_type) );
+                btea3_schedule_init( &m_move_key, k );
+                m_frame_cache.clear();
             }
             inline void set_line_key( ckey_type k )
             {
-                memcpy( m_line_key, k, sizeof(ckey_type) );
+                btea3_schedule_init( &m_line_key, k );
+                m_frame_cache.clear();
             }
             inline void set_curve_key( ckey_type k )
             {
-                memcpy( m_curve_key, k, sizeof(ckey_type) );
+                btea3_schedule_init( &m_curve_key, k );
+                m_frame_cache.clear();
+            }
+            /* Identifies the three keys, so caches of whole jobs can
+               tell frames made with other keys apart */
+            uint64_t key_id() const;
+            uint64_t key_id( stat_type type ) const;
+            /* Keep up to slots encrypted frames by type and point, and
+               reuse them when a point comes back (0, the default, turns
+               it off). Only move/cut/curve and encode_frame look here;
+               submit and encode_job encrypt whole batches instead. */
+            inline void set_frame_cache( std::size_t slots )
+            {
+                m_frame_cache.resize( slots );
+                m_frame_cache.reset_stats();
+            }
+            inline const cache_stats & get_frame_cache_stats() const
+            {
+                return m_frame_cache.get_stats();
             }
             inline bool is_open()
             {
-                return m_serial.is_open();
+                return m_port->is_open();
+            }
+            /* Talk through another transport instead of the serial port;
+               NULL goes back to the serial port */
+            inline void set_transport( transport * port )
+            {
+                m_port = port != NULL ? port : &m_serial;
+            }
+            inline void set_tx_mode( serial_port::tx_mode_t mode )
+            {
+                m_serial.set_tx_mode( mode );
+            }
+            inline bool set_link_rate( int rate )
+            {
+                return m_serial.set_link_rate( rate );
+            }
+            inline int get_link_rate() const
+            {
+                return m_serial.get_link_rate();
             }
+            /* How long to wait for each ack (negative waits forever), and
+               how many times to resend a move or line whose ack never
+               came (default 0; curve frames are never resent) */
+            inline void set_ack_timeout( int ms )
+            {
+                m_ack_timeout = ms;
+            }
+            inline void set_ack_retries( int retries )
+            {
+                m_ack_retries = retries;
+            }
+            inline transport::read_status_t last_ack_status() const
+            {
+                return __atomic_load_n( &m_ack_status, __ATOMIC_RELAXED );
+            }
+
+            /* With a window above 1, move/cut/curve return once their
+               frames are written and acks are collected in order later;
+               an ack failure is reported by whichever call collects it */
+            void set_window( int window );
+            inline int get_window() const
+            {
+                return m_window;
+            }
+            /* Find the largest window the device acks in full, by
+               bursts of moves to where the head is; not while the I/O
+               thread runs (returns 0) */
+            int  probe_window( int max_window );
+            /* Let up to this many consecutive frames share one write
+               (default 1). Each still needs a window slot, so this only
+               has an effect with a window above 1. The frames leave back
+               to back, so only raise it if the device keeps up. */
+            void set_max_coalesce( int frames );
+            inline int get_max_coalesce() const
+            {
+                return m_max_coalesce;
+            }
+            bool wait_idle();
+            /* Try each rate with a burst of moves to where the head
+               already is, pipelined up to the current window, and leave
+               the port at the fastest rate that acked every one
+               (returned; 0 if none did). Resets stats. */
+            int  calibrate_link_rate( const int * rates, int count, int trials, link_trial * results = NULL );
+
+            /* Hand writes and acks to a thread of its own, fed through a
+               ring of encoded frames, so move/cut/curve only block while
+               the ring is full. Once the thread hits an error it sends
+               nothing more and every call fails until wait_idle (or start
+               or stop) reports it; the frames still queued then count
+               towards unacked_commands(). Set the window and transport
+               beforehand. */
+            bool start_io_thread( std::size_t ring_size = IO_RING_SIZE );
+            void stop_io_thread();
+            inline bool io_thread_running() const
+            {
+                return m_io_ring != NULL;
+            }
+            /* Pinning, SCHED_FIFO and locked memory for the I/O thread,
+               applied when it starts; start_io_thread() prints anything
+               that could not be had. Without the I/O thread, call
+               enter_realtime() from the thread driving the cutter. */
+            inline void set_realtime( const realtime_config & config )
+            {
+                m_rt_config = config;
+            }
+            inline const realtime_report & get_realtime_report() const
+            {
+                return m_rt_report;
+            }
+
+            /* Counts and encode/write/ack latency histograms for each
+               command type, printed by stop() while enabled. The I/O
+               thread keeps them while it runs: read them only after
+               wait_idle() (stop() does). */
+            inline void enable_stats( bool enable )
+            {
+                __atomic_store_n( &m_stats_enabled, enable, __ATOMIC_RELAXED );
+            }
+            inline bool stats_enabled() const
+            {
+                return stats_on();
+            }
+            inline const command_stats & get_stats( stat_type type ) const
+            {
+                return m_stats[ type ];
+            }
+            /* Frames given up on without an ack: timed out, behind one
+               that timed out, or still queued for the I/O thread when it
+               failed. Counted with stats off too; reset_stats() clears it. */
+            inline uint64_t unacked_commands() const
+            {
+                return __atomic_load_n( &m_unacked, __ATOMIC_RELAXED );
+            }
+            void reset_stats();
+            void dump_stats( std::ostream & out ) const;
         private:
+            struct pending_ack
+            {
+                uint64_t  sent;
+                stat_type type;
+            };
+            struct io_frame
+            {
+                lmc_command frame;
+                stat_type   type;
+            };
+
             inline int get_rand() const
             {
                 /*No, we're not bad at math. This is cryptographic padding
@@ -71,12 +282,56 @@ namespace Device
                 since the cryto-keys are in the wild.*/
                 return 12345;
             };
-            xy convert_to_internal( const xy &input );
-            bool do_command( const xy &pt, const ckey_type k );
-            ckey_type m_move_key;
-            ckey_type m_line_key;
-            ckey_type m_curve_key;
+            bool do_command( const ixy &pt, const btea3_schedule &ks, stat_type type );
+            void encode( const ixy &pt, const btea3_schedule &ks, lmc_command &l, stat_type type );
+            void fill_frame( const ixy &pt, lmc_command &l ) const;
+            void encrypt_frames( lmc_command * l, std::size_t count, const btea3_schedule &ks, stat_type type );
+            const btea3_schedule & key_for( stat_type type ) const;
+            void encode_range( const unit_command * cmds, std::size_t begin, std::size_t end, encoded_job & job ) const;
+            static void * encode_worker( void * arg );
+            bool transmit( const uint8_t * data, std::size_t size, stat_type type );
+            bool send_frame( const lmc_command &l, stat_type type );
+            bool write_frame( const lmc_command &l, stat_type type );
+            bool write_frames( const io_chunk * chunks, const stat_type * types, std::size_t count );
+            std::size_t coalesce( std::size_t available ) const;
+            bool queue_frame( const lmc_command &l, stat_type type );
+            static void * io_thread( void * arg );
+            void io_loop();
+            bool wait_ack();
+            bool reap_ack();
+            void io_settle();
+            inline bool stats_on() const
+            {
+                return __atomic_load_n( &m_stats_enabled, __ATOMIC_RELAXED );
+            }
+            std::size_t drop_pending();
+            btea3_schedule m_move_key;
+            btea3_schedule m_line_key;
+            btea3_schedule m_curve_key;
+            frame_cache m_frame_cache;
             serial_port m_serial;
+            transport * m_port;
+            int m_ack_timeout;
+            int m_ack_retries;
+            transport::read_status_t m_ack_status;
+            ixy m_position;
+            int m_window;
+            int m_max_coalesce;
+            pending_ack m_pending[ MAX_WINDOW ];
+            int m_pending_head;
+            int m_pending_count;
+            bool m_stats_enabled;
+            command_stats m_stats[ NUM_STAT_TYPES ];
+            uint64_t m_unacked;
+            spsc_ring<io_frame> * m_io_ring;
+            pthread_t m_io_thread;
+            bool m_io_run;
+            bool m_io_error;
+            bool m_io_reset;
+            int m_io_pending;
+            bool m_io_started;
+            realtime_config m_rt_config;
+            realtime_report m_rt_report;
     };
 }
 #endif
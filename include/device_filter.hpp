@@ -0,0 +1,107 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef DEVICE_FILTER_HPP
+#define DEVICE_FILTER_HPP
+
+#include <stdint.h>
+#include <ostream>
+
+#include "device.hpp"
+#include "types.h"
+
+namespace Device
+{
+    /* What a Filter did with one job, reset by start() */
+    struct filter_stats
+    {
+        uint64_t commands;          /* calls coming in */
+        uint64_t sent;              /* calls passed on */
+        uint64_t moves_merged;      /* moves overtaken by a later move */
+        uint64_t moves_in_place;    /* moves to where the head already was */
+        uint64_t empty_cuts;        /* cuts that would not leave the spot */
+        uint64_t empty_curves;      /* curves with every point on the spot */
+
+        inline uint64_t dropped() const
+        {
+            return moves_merged + moves_in_place + empty_cuts + empty_curves;
+        }
+    };
+
+    /*
+     * Sits in front of another device and snaps every point to the
+     * device's resolution, then only passes on commands that would move
+     * the head. A move is held back until the next cut or curve, so a run
+     * of moves collapses into the last one; whatever move is still held
+     * goes out on flush() or stop().
+     */
+    class Filter : public Device::Generic
+    {
+        public:
+            /* Device C resolution */
+            static const int DEFAULT_UNITS_PER_INCH = 404;
+
+            Filter( Generic & device, int units_per_inch = DEFAULT_UNITS_PER_INCH );
+            /* virtual */ void init( std::string aSerial );
+            /* virtual */ const std::string device_name();
+            /* virtual */ bool move_to( const xy &aPoint );
+            /* virtual */ bool cut_to( const xy &aPoint );
+            /* virtual */ bool curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 );
+            /* virtual */ std::size_t submit( const command * cmds, std::size_t count );
+            /* virtual */ std::size_t submit_units( const unit_command * cmds, std::size_t count );
+            /* virtual */ inline int get_units_per_inch()
+            {
+                return m_units;
+            }
+            /* virtual */ bool start();
+            /* virtual */ bool stop();
+            /* virtual */ xy   get_dimensions();
+
+            /* Send the held move, if any */
+            bool flush();
+
+            inline const filter_stats & get_stats() const
+            {
+                return m_stats;
+            }
+            void reset_stats();
+            void dump_stats( std::ostream & out ) const;
+
+        private:
+            unit_command quantise( const command & cmd ) const;
+            bool filter( const unit_command & in, unit_command out[2], std::size_t & count );
+            bool take_pending( unit_command out[2], std::size_t & count );
+            bool forward( const command & cmd );
+            std::size_t send( const unit_command * cmds, std::size_t count );
+
+            Generic & m_device;
+            int m_units;
+            ixy m_position;
+            bool m_position_known;
+            ixy m_pending;
+            bool m_have_pending;
+            filter_stats m_stats;
+    };
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef DEVICE_RECORDER_HPP
+#define DEVICE_RECORDER_HPP
+
+#include <vector>
+
+#include "device.hpp"
+#include "types.h"
+
+namespace Device
+{
+    /*
+     * Stands in for a cutter and only keeps what it is told, so a
+     * frontend can run a whole job without a port; see compile_cutbin().
+     * Every call succeeds, and start() and stop() leave the recording
+     * alone, so a job run in several parts comes out as one.
+     */
+    class Recorder : public Device::Generic
+    {
+        public:
+            Recorder( const xy & dimensions );
+            /* virtual */ const std::string device_name();
+            /* virtual */ bool move_to( const xy &aPoint );
+            /* virtual */ bool cut_to( const xy &aPoint );
+            /* virtual */ bool curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 );
+            /* virtual */ bool start();
+            /* virtual */ bool stop();
+            /* virtual */ xy   get_dimensions();
+
+            inline const std::vector<command> & get_commands() const
+            {
+                return m_commands;
+            }
+            void clear();
+
+        private:
+            xy m_dimensions;
+            std::vector<command> m_commands;
+    };
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef FILE_UTIL_HPP
+#define FILE_UTIL_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+/* Every file the library writes (captures, .job, .cutbin) stores its
+   integers little endian, whatever the host */
+inline void put_le( uint8_t * buf, uint32_t value, int bytes = 4 )
+{
+    for( int i = 0; i < bytes; ++i )
+    {
+        buf[i] = ( value >> ( 8 * i ) ) & 0xFF;
+    }
+}
+
+inline uint32_t get_le( const uint8_t * buf, int bytes = 4 )
+{
+    uint32_t value = 0;
+    for( int i = bytes - 1; i >= 0; --i )
+    {
+        value = ( value << 8 ) | buf[i];
+    }
+    return value;
+}
+
+inline void put_le64( uint8_t * buf, uint64_t value )
+{
+    put_le( buf, (uint32_t)value );
+    put_le( buf + 4, (uint32_t)( value >> 32 ) );
+}
+
+inline uint64_t get_le64( const uint8_t * buf )
+{
+    return get_le( buf ) | ( (uint64_t)get_le( buf + 4 ) << 32 );
+}
+
+/* Write size bytes as the new contents of file: written aside to
+   file.new and renamed over it, so a reader or a crash never sees half
+   a file */
+bool replace_file( const std::string & file, const void * data, std::size_t size );
+#endif
@@ -0,0 +1,117 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef FRAME_CACHE_HPP
+#define FRAME_CACHE_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <ostream>
+
+#include "types.h"
+#include "lmc_command.hpp"
+#include "command_stats.hpp"
+
+/* Lookups made against one of the caches below */
+struct cache_stats
+{
+    uint64_t hits;
+    uint64_t disk_hits;     /* job_cache only: hits loaded from disk */
+    uint64_t misses;
+    uint64_t evictions;     /* entries pushed out by a different one */
+
+    inline uint64_t lookups() const
+    {
+        return hits + disk_hits + misses;
+    }
+};
+
+void print_cache_stats( std::ostream & out, const char * name, const cache_stats & stats );
+
+/* 64 bit FNV-1a, continuing from hash */
+static const uint64_t FNV1A_INIT = 0xcbf29ce484222325ULL;
+uint64_t fnv1a( const void * data, std::size_t size, uint64_t hash = FNV1A_INIT );
+
+/*
+ * Encrypted frames keyed on command type and point in device units,
+ * for geometry that keeps coming back to the same spots. Direct mapped:
+ * each key has exactly one slot, and a new frame simply replaces
+ * whatever was there. The owner must clear() it whenever the key a
+ * type is encrypted with changes.
+ */
+class frame_cache
+{
+    public:
+        /* 0 slots is a disabled cache that never hits */
+        frame_cache( std::size_t slots = 0 );
+        ~frame_cache();
+
+        /* Drop everything and resize, rounded up to a power of two */
+        void resize( std::size_t slots );
+        void clear();
+        inline bool enabled() const
+        {
+            return m_slots != NULL;
+        }
+        inline std::size_t size() const
+        {
+            return m_mask + 1;
+        }
+
+        bool lookup( stat_type type, const ixy & pt, lmc_command & l );
+        void insert( stat_type type, const ixy & pt, const lmc_command & l );
+
+        inline const cache_stats & get_stats() const
+        {
+            return m_stats;
+        }
+        void reset_stats();
+
+    private:
+        struct slot
+        {
+            int32_t     x;
+            int32_t     y;
+            int32_t     type;   /* -1 when empty */
+            lmc_command frame;
+        };
+
+        //Not copyable
+        frame_cache( const frame_cache & );
+        frame_cache & operator=( const frame_cache & );
+
+        inline std::size_t index( stat_type type, const ixy & pt ) const
+        {
+            uint64_t k = ( (uint64_t)(uint32_t)pt.x << 32 ) | (uint32_t)pt.y;
+
+            k ^= (uint64_t)type * 0x9e3779b97f4a7c15ULL;
+            k *= 0xff51afd7ed558ccdULL;
+            return ( k ^ ( k >> 29 ) ) & m_mask;
+        }
+
+        slot * m_slots;
+        std::size_t m_mask;
+        cache_stats m_stats;
+};
+#endif
@@ -0,0 +1,104 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef JOB_CACHE_HPP
+#define JOB_CACHE_HPP
+
+#include <stdint.h>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "device_c.hpp"
+#include "frame_cache.hpp"
+
+namespace Device
+{
+    /*
+     * Whole encoded jobs by content: a hash of the toolpath in device
+     * units and of the keys it is encrypted with. A job seen before comes
+     * back out of memory, or out of the cache directory when one is set,
+     * and goes to send_job() without encrypting a single frame. Memory
+     * holds up to max_jobs, dropping the least recently used.
+     */
+    class job_cache
+    {
+        public:
+            static const std::size_t DEFAULT_JOBS = 8;
+
+            job_cache( std::size_t max_jobs = DEFAULT_JOBS, const std::string & dir = "" );
+
+            static uint64_t hash( const unit_command * cmds, std::size_t count, uint64_t key_id );
+
+            /* The cached job, or NULL. Stays valid until the next store() */
+            const C::encoded_job * find( uint64_t hash );
+            /* Takes job over, leaving it empty, and writes it to the
+               cache directory if there is one */
+            const C::encoded_job * store( uint64_t hash, C::encoded_job & job );
+            /* find(), or encode_job() and store() on a miss; NULL if
+               the toolpath cannot all be encoded */
+            const C::encoded_job * get( C & device, const unit_command * cmds, std::size_t count );
+
+            /* Where jobs are kept on disk; empty keeps them in memory only */
+            inline void set_dir( const std::string & dir )
+            {
+                m_dir = dir;
+            }
+            inline const std::string & get_dir() const
+            {
+                return m_dir;
+            }
+            std::string file_for( uint64_t hash ) const;
+            void clear();
+
+            inline const cache_stats & get_stats() const
+            {
+                return m_stats;
+            }
+            void reset_stats();
+            void dump_stats( std::ostream & out ) const;
+
+        private:
+            struct entry
+            {
+                C::encoded_job job;
+                uint64_t used;
+            };
+
+            entry & insert( uint64_t hash );
+
+            std::map<uint64_t, entry> m_jobs;
+            std::size_t m_max_jobs;
+            std::string m_dir;
+            uint64_t m_clock;
+            cache_stats m_stats;
+    };
+
+    /* An encoded job as a file: a small header, the command table, and
+       the frames exactly as they go on the wire */
+    bool save_job( const std::string & file, const C::encoded_job & job, uint64_t hash );
+    /* Fails on anything that is not a whole, consistent job file */
+    bool load_job( const std::string & file, C::encoded_job & job, uint64_t & hash );
+}
+#endif
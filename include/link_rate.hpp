@@ -0,0 +1,46 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef LINK_RATE_HPP
+#define LINK_RATE_HPP
+#include <string>
+
+/* One rate tried by Device::C::calibrate_link_rate() */
+struct link_trial
+{
+    int    rate;
+    int    sent;
+    int    acked;
+    double rtt_mean;            /* usecs */
+    double rtt_p99;             /* usecs */
+};
+
+/*
+ * Calibrated link rates are kept one per line as "device rate" in the
+ * file named by CUTTER_LINK_RATES, or ~/.cutter_link_rates.
+ */
+std::string link_rate_file();
+bool load_link_rate( const std::string & device, int & rate );
+bool save_link_rate( const std::string & device, int rate );
+#endif
@@ -0,0 +1,61 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef LMC_COMMAND_HPP
+#define LMC_COMMAND_HPP
+
+#include <stdint.h>
+
+/* One Device C command frame exactly as it goes on the wire */
+struct __attribute__(( packed )) lmc_command
+{
+    uint8_t  bytes;
+    uint8_t  cmd;
+    uint32_t data[3];
+};
+
+/******************************************
+Host endianness TO device C endianness Long
+
+Device C talks little endian, so
+iff LE, return LE
+iff BE, return LE
+else assert
+******************************************/
+static inline uint32_t htocl( const uint32_t input )
+{
+#if defined(  _BIG_ENDIAN )
+return ( ( input & 0x000000FF ) << 24 ) |
+       ( ( input & 0x0000FF00 ) << 8  ) |
+       ( ( input & 0x00FF0000 ) >> 8  ) |
+       ( ( input & 0xFF000000 ) >> 24 ) ;
+#elif defined( _MIDDLE_ENDIAN ) || defined( _PDP_ENDIAN )
+return ( ( input & 0x0000FFFF ) << 16 ) |
+       ( ( input & 0xFFFF0000 ) >> 16 ) ;
+#else
+//Assume little endian
+return input;
+#endif
+}
+#endif
@@ -0,0 +1,120 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef PORT_LOOP_HPP
+#define PORT_LOOP_HPP
+#include <stdint.h>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "serial_port.hpp"
+#include "lmc_command.hpp"
+
+/*
+ * Drives any number of serial ports from one thread with epoll. Each port
+ * keeps its own frame queue, its own pacing and ack deadlines on a timerfd,
+ * and its own window of commands waiting for acks. Every queued frame is
+ * completed exactly once through its callback: when its ack arrives, when
+ * it has been written for start and stop, or with READ_TIMEOUT or
+ * READ_ERROR when the port fails it. Callbacks may queue more frames, on
+ * the failing port too (they go out on a later pass), but must not
+ * remove ports. A port whose link hangs up or errors has everything on
+ * it failed and is no longer polled; queueing on it fails from then on.
+ */
+class port_loop
+{
+    public:
+        typedef void (*completion_fn)( int port, transport::read_status_t status, void * closure );
+
+        port_loop();
+        ~port_loop();
+
+        /* The port must already be open. Returns an id for the calls
+           below, or -1 */
+        int  add_port( serial_port * port, int window = 1, int ack_timeout_ms = 10000 );
+        void remove_port( int id );
+
+        /* Use Device::C::encode_frame() to build the frames. Start and
+           stop wait for everything queued before them to be acked */
+        bool queue_frame( int id, const lmc_command & l, completion_fn done = NULL, void * closure = NULL );
+        bool queue_start( int id, completion_fn done = NULL, void * closure = NULL );
+        bool queue_stop(  int id, completion_fn done = NULL, void * closure = NULL );
+
+        /* Frames queued or in flight on one port */
+        std::size_t pending( int id ) const;
+        bool idle() const;
+
+        /* Handle whatever is ready, waiting up to timeout_ms (forever if
+           negative) for something to be. Returns frames completed */
+        int  run_once( int timeout_ms );
+        void run();
+
+    private:
+        struct entry
+        {
+            uint8_t       data[ sizeof( lmc_command ) ];
+            uint8_t       size;
+            bool          acked;
+            bool          settle;
+            completion_fn done;
+            void        * closure;
+            uint64_t      deadline;
+        };
+
+        struct port_state
+        {
+            serial_port      * port;
+            int                fd;
+            int                timer;
+            int                old_flags;
+            int                window;
+            int                ack_timeout;
+            std::deque<entry>  queue;
+            std::deque<entry>  in_flight;
+            std::size_t        written;
+            std::size_t        rx;
+            uint64_t           ready;
+            bool               settled;
+            bool               want_out;
+            bool               out_armed;
+            bool               dead;
+            uint64_t           timer_at;
+        };
+
+        port_loop( const port_loop & );
+        port_loop & operator=( const port_loop & );
+
+        bool queue_entry( int id, const uint8_t * data, std::size_t size, bool acked, bool settle, completion_fn done, void * closure );
+        void service( int id, port_state & p );
+        void read_acks( int id, port_state & p );
+        void complete( int id, const entry & e, transport::read_status_t status );
+        void fail( int id, std::deque<entry> & q, transport::read_status_t status );
+        void hang_up( int id, port_state & p );
+        void arm( int id, port_state & p, uint64_t now );
+
+        int                       epfd;
+        std::vector<port_state *> ports;
+        int                       completed;
+};
+#endif
@@ -0,0 +1,66 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+#include <cstddef>
+#include <ostream>
+
+/* What to ask of the scheduler for the thread doing port I/O */
+struct realtime_config
+{
+    int  cpu;                   /* CPU to pin to, -1 to leave alone */
+    int  priority;              /* SCHED_FIFO priority 1-99, 0 to leave alone */
+    bool lock_memory;           /* mlockall() and pre-fault the stack */
+
+    realtime_config() : cpu( -1 ), priority( 0 ), lock_memory( false )
+    {
+    }
+    bool requested() const
+    {
+        return cpu >= 0 || priority > 0 || lock_memory;
+    }
+};
+
+/* What we actually got; the errors are errno values, 0 if it worked */
+struct realtime_report
+{
+    bool pinned;
+    bool fifo;
+    bool locked;
+    int  pin_error;
+    int  fifo_error;
+    int  lock_error;
+};
+
+/*
+ * Apply config to the calling thread. Anything that fails is left as it
+ * was and noted in the report; returns true only if everything asked for
+ * was granted.
+ */
+bool enter_realtime( const realtime_config & config, realtime_report & report );
+void print_realtime_report( std::ostream & out, const realtime_config & config, const realtime_report & report );
+/* Touch every page so the first real use does not take a fault */
+void prefault( void * data, std::size_t size );
+#endif
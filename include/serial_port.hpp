@@ -38,29 +38,85 @@
 #endif
 
 #include <string>
+#include "transport.hpp"
+#include "capture.hpp"
+#include "command_stats.hpp"
 
 #define TIMING_GOAL (.001)
 #define TIMING_CONSTRAINT (.00025)
 #define BAUD_RATE B38400
 
-class serial_port
+/* Default rate programmed through the custom divisor, and the bits
+   on the wire per byte: start + 8 data + 2 stop (CSTOPB) */
+#define LINK_RATE 200000
+#define BITS_PER_BYTE 11
+
+/* How closely the transmit scheduler has kept to its deadlines */
+struct pacing_stats
+{
+    uint64_t paced;             /* deadlines waited on */
+    uint64_t late;              /* woke more than TIMING_CONSTRAINT late */
+    uint64_t total_lateness;    /* usecs */
+    uint64_t max_lateness;      /* usecs */
+    latency_histogram lateness; /* every wakeup, in ns like the others */
+};
+
+class uring_io;
+
+class serial_port : public transport
 {
     public:
+        enum tx_mode_t
+        {
+            TX_PER_BYTE,        /* one write() per byte, gap before each */
+            TX_FRAME            /* whole frame per write(), paced by wire time */
+        };
+
         serial_port();
-        serial_port( const std::string & filename );
+        serial_port( const std::string & filename, int rate = 0 );
         ~serial_port();
 
         bool is_open();
-        void p_open( const std::string & filename );
+        /* rate 0 opens at the rate saved for this device by
+           cutter_calibrate, or LINK_RATE if there is none */
+        void p_open( const std::string & filename, int rate = 0 );
         void p_close();
 
         std::size_t p_write( const uint8_t * data, std::size_t size );
+        std::size_t p_writev( const io_chunk * chunks, std::size_t count );
         std::size_t p_read(  uint8_t * data, std::size_t size );
+        read_status_t p_read_timed( uint8_t * data, std::size_t size, int timeout_ms, std::size_t & count );
+        void flush_input();
 	int delay(int);
 
+        void      set_tx_mode( tx_mode_t mode );
+        tx_mode_t get_tx_mode() const;
+        void      set_byte_gap( int usecs );
+        int       get_byte_gap() const;
+        int       byte_time() const;
+        /* false if the driver refused the rate; pacing follows it anyway */
+        bool      set_link_rate( int rate );
+        int       get_link_rate() const;
+
+        uint64_t pace_until( uint64_t deadline );
+        const pacing_stats & get_pacing_stats() const;
+        void reset_pacing_stats();
+
+        /* Log every byte sent and received, with timestamps, to a capture
+           file. Also started by p_open() when CUTTER_CAPTURE names a file */
+        bool start_capture( const std::string & filename );
+        void stop_capture();
+        /* Log traffic that bypassed p_write/p_read (see port_loop) */
+        void record( capture_dir dir, const uint8_t * data, std::size_t size );
+
+    #if( !__WIN32 )
+        int get_fd() const;
+    #endif
+
     protected:
     #if( !__WIN32 )
         int  fd;
+        uring_io * uring;
 
         termios       oldtio;
     #if( __linux )
@@ -71,6 +127,15 @@ class serial_port
         DCB olddcb;
     #endif
 
-        const uint64_t getTime();
+        read_status_t read_timed( uint8_t * data, std::size_t size, int timeout_ms, std::size_t & count );
+        std::size_t write_per_byte( const uint8_t * data, std::size_t size );
+        std::size_t write_frame( const uint8_t * data, std::size_t size );
+
+        tx_mode_t tx_mode;
+        int       byte_gap;
+        int       link_rate;
+        uint64_t  tx_ready;
+        pacing_stats pacing;
+        capture_writer capture;
 };
 #endif
@@ -0,0 +1,119 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+#include <cstddef>
+
+/*
+ * Fixed size ring for exactly one producer thread and one consumer
+ * thread. No locks: each side only ever writes its own index, and the
+ * acquire/release pairs make the slot contents visible before the index
+ * that publishes them.
+ */
+template <typename T>
+class spsc_ring
+{
+    public:
+        /* capacity is rounded up to a power of two */
+        spsc_ring( std::size_t capacity )
+        {
+            size = 1;
+            while( size < capacity )
+            {
+                size <<= 1;
+            }
+            mask  = size - 1;
+            //Value-initialised, which also faults every page in now
+            slots = new T[ size ]();
+            head  = 0;
+            tail  = 0;
+        }
+
+        ~spsc_ring()
+        {
+            delete [] slots;
+        }
+
+        /* Producer side; false when full */
+        bool push( const T & item )
+        {
+            std::size_t t = __atomic_load_n( &tail, __ATOMIC_RELAXED );
+
+            if( t - __atomic_load_n( &head, __ATOMIC_ACQUIRE ) >= size )
+            {
+                return false;
+            }
+            slots[ t & mask ] = item;
+            __atomic_store_n( &tail, t + 1, __ATOMIC_RELEASE );
+            return true;
+        }
+
+        /* Consumer side; false when empty */
+        bool pop( T & item )
+        {
+            std::size_t h = __atomic_load_n( &head, __ATOMIC_RELAXED );
+
+            if( h == __atomic_load_n( &tail, __ATOMIC_ACQUIRE ) )
+            {
+                return false;
+            }
+            item = slots[ h & mask ];
+            __atomic_store_n( &head, h + 1, __ATOMIC_RELEASE );
+            return true;
+        }
+
+        /* Consumer side: look at the next item without taking it */
+        T * peek( std::size_t ahead = 0 )
+        {
+            std::size_t h = __atomic_load_n( &head, __ATOMIC_RELAXED );
+
+            if( __atomic_load_n( &tail, __ATOMIC_ACQUIRE ) - h <= ahead )
+            {
+                return NULL;
+            }
+            return &slots[ ( h + ahead ) & mask ];
+        }
+
+        std::size_t count() const
+        {
+            return __atomic_load_n( &tail, __ATOMIC_ACQUIRE ) - __atomic_load_n( &head, __ATOMIC_ACQUIRE );
+        }
+
+        std::size_t capacity() const
+        {
+            return size;
+        }
+
+    private:
+        spsc_ring( const spsc_ring & );
+        spsc_ring & operator=( const spsc_ring & );
+
+        T         * slots;
+        std::size_t size;
+        std::size_t mask;
+        std::size_t head;
+        std::size_t tail;
+};
+#endif
@@ -0,0 +1,123 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+
+/* One buffer of a gathered write */
+struct io_chunk
+{
+    const uint8_t * data;
+    std::size_t     size;
+};
+
+/*
+ * A byte link to a cutter. Device::C only ever talks through this, so the
+ * real serial port can be swapped for something faster or fake.
+ */
+class transport
+{
+    public:
+        enum read_status_t
+        {
+            READ_OK,            /* all requested bytes arrived */
+            READ_TIMEOUT,       /* deadline passed, partial data kept */
+            READ_ERROR          /* port closed or read failed */
+        };
+
+        virtual ~transport();
+
+        virtual bool is_open() = 0;
+        virtual std::size_t p_write( const uint8_t * data, std::size_t size ) = 0;
+        /* Several buffers back to back; one p_write() each unless the
+           link can do better */
+        virtual std::size_t p_writev( const io_chunk * chunks, std::size_t count );
+        virtual read_status_t p_read_timed( uint8_t * data, std::size_t size, int timeout_ms, std::size_t & count ) = 0;
+        virtual void flush_input() = 0;
+        virtual int delay( int usecs ) = 0;
+
+        const uint64_t getTime();
+};
+
+
+/*
+ * Swallows frames in memory and answers every command with an ack at
+ * once, so the encode path can be measured with no I/O cost at all.
+ */
+class loopback_transport : public transport
+{
+    public:
+        loopback_transport();
+
+        bool is_open();
+        std::size_t p_write( const uint8_t * data, std::size_t size );
+        read_status_t p_read_timed( uint8_t * data, std::size_t size, int timeout_ms, std::size_t & count );
+        void flush_input();
+        int delay( int usecs );
+
+        inline uint64_t bytes_written() const
+        {
+            return bytes;
+        }
+        inline uint64_t frames_written() const
+        {
+            return frames;
+        }
+
+    protected:
+        void parse( const uint8_t * data, std::size_t size );
+
+        uint64_t    bytes;
+        uint64_t    frames;
+        std::size_t frame_left;
+        bool        frame_first;
+        bool        frame_acked;
+        std::size_t ack_bytes;
+};
+
+
+/*
+ * Records the exact byte stream to a file or pipe ("-" for stdout) and
+ * acks like the loopback.
+ */
+class file_transport : public loopback_transport
+{
+    public:
+        file_transport();
+        file_transport( const std::string & filename );
+        ~file_transport();
+
+        void p_open( const std::string & filename );
+        void p_close();
+
+        bool is_open();
+        std::size_t p_write( const uint8_t * data, std::size_t size );
+
+    protected:
+        FILE * out;
+};
+#endif
@@ -36,5 +36,14 @@ struct xy
 	~xy(){};
 };
 
+/* A point in device units, as it goes on the wire */
+struct ixy
+{
+    int32_t x;
+    int32_t y;
+	ixy(){};
+	ixy(int32_t _x, int32_t _y){x=_x;y=_y;};
+};
+
 typedef uint32_t ckey_type[4];
 #endif
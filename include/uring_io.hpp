@@ -0,0 +1,104 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#ifndef URING_IO_HPP
+#define URING_IO_HPP
+#include <stdint.h>
+#include <cstddef>
+#include <linux/io_uring.h>
+#include "transport.hpp"
+
+/*
+ * io_uring engine behind serial_port when libcutter is built with
+ * CUTTER_IO_URING. The port is a registered file, frames are copied into
+ * a registered transmit ring and acks land in a registered receive
+ * buffer, and each ack wait is one read linked to an absolute timeout:
+ * a command costs one io_uring_enter() to send and one to collect its
+ * ack, or none with an SQ poll thread once it is running.
+ */
+class uring_io
+{
+    public:
+        static const unsigned    ENTRIES  = 16;
+        static const std::size_t TX_BYTES = 4096;
+        static const std::size_t RX_BYTES = 256;
+
+        uring_io();
+        ~uring_io();
+
+        /* false when the kernel refuses; the caller keeps using
+           plain read()/write() */
+        bool setup( int fd, bool sqpoll );
+        void teardown();
+
+        /* Queues the write and returns; a failure is reported by the
+           next write() or read(). Only one write is in flight at a time,
+           which keeps frames in order on the wire. */
+        bool write( const uint8_t * data, std::size_t size );
+        bool write( const io_chunk * chunks, std::size_t count );
+        /* deadline is in getTime() microseconds, 0 to wait forever */
+        transport::read_status_t read( uint8_t * data, std::size_t size, uint64_t deadline, std::size_t & count );
+
+    private:
+        uring_io( const uring_io & );
+        uring_io & operator=( const uring_io & );
+
+        io_uring_sqe * get_sqe( unsigned ahead = 0 );
+        bool enter( unsigned wait );
+        void reap();
+        bool wait_for( const bool & flag );
+
+        int        ring_fd;
+        bool       sqpoll;
+        unsigned   to_submit;
+
+        void     * sq_map;
+        std::size_t sq_map_size;
+        void     * cq_map;
+        std::size_t cq_map_size;
+        io_uring_sqe * sqes;
+        std::size_t sqes_size;
+
+        unsigned * sq_head;
+        unsigned * sq_tail;
+        unsigned * sq_mask;
+        unsigned * sq_flags;
+        unsigned * sq_array;
+        unsigned * cq_head;
+        unsigned * cq_tail;
+        unsigned * cq_mask;
+        io_uring_cqe * cqes;
+
+        uint8_t  * tx_buf;
+        uint8_t  * rx_buf;
+        std::size_t tx_off;
+
+        bool       write_done;
+        bool       write_failed;
+        bool       read_done;
+        int        read_result;
+        bool       timeout_done;
+        __kernel_timespec timeout;
+};
+#endif
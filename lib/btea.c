@@ -16,6 +16,9 @@
 static void swap_bytes( uint32_t *v, unsigned int word_count );
 #endif
 
+//( sqrt( 5 ) - 1 ) / 2
+#define BTEA_DELTA 0x9e3779b9
+
 int btea( uint32_t * v, int32_t n, const uint32_t * k_in )
 {
     uint32_t z;
@@ -37,8 +40,7 @@ int btea( uint32_t * v, int32_t n, const uint32_t * k_in )
 
     memcpy( &k, k_in, sizeof(uint32_t)*4 );
 
-    //( sqrt( 5 ) - 1 ) / 2
-    const uint32_t DELTA=0x9e3779b9 ;
+    const uint32_t DELTA=BTEA_DELTA ;
 
     int32_t p;
     int32_t q;
@@ -122,3 +124,176 @@ static void swap_bytes( uint32_t *v, unsigned int word_count )
     }
 }
 #endif
+
+
+/*
+ * btea() with n fixed at 3. The three words live in locals for the whole
+ * run and each round is written out in full, so nothing but the 23 round
+ * iterations is left to loop over. The round sums and the key word each
+ * step uses come straight out of a btea3_schedule.
+ */
+#define MX3( p ) ( ( ( z >> 5 ) ^ ( y << 2 ) ) + ( ( y >> 3 ) ^ ( z << 4 ) ) ) ^ ( ( sum ^ y ) + ( key[ p ] ^ z ) )
+
+static inline void btea3_block( uint8_t * data, const btea3_schedule * ks )
+{
+    uint32_t v0;
+    uint32_t v1;
+    uint32_t v2;
+    uint32_t y;
+    uint32_t z;
+    uint32_t sum;
+    const uint32_t * key;
+    int q;
+
+    //The payload may sit unaligned inside a wire frame
+    memcpy( &v0, data,     sizeof( uint32_t ) );
+    memcpy( &v1, data + 4, sizeof( uint32_t ) );
+    memcpy( &v2, data + 8, sizeof( uint32_t ) );
+
+    #if( _BIG_ENDIAN )
+    {
+        uint32_t w[3] = { v0, v1, v2 };
+        swap_bytes( w, 3 );
+        v0 = w[0]; v1 = w[1]; v2 = w[2];
+    }
+    #endif
+
+    z = v2;
+    for( q = 0; q < BTEA3_ROUNDS; q++ )
+    {
+        sum = ks->sum[q];
+        key = ks->key[q];
+        y = v1; z = v0 += MX3( 0 );
+        y = v2; z = v1 += MX3( 1 );
+        y = v0; z = v2 += MX3( 2 );
+    }
+
+    #if( _BIG_ENDIAN )
+    {
+        uint32_t w[3] = { v0, v1, v2 };
+        swap_bytes( w, 3 );
+        v0 = w[0]; v1 = w[1]; v2 = w[2];
+    }
+    #endif
+
+    memcpy( data,     &v0, sizeof( uint32_t ) );
+    memcpy( data + 4, &v1, sizeof( uint32_t ) );
+    memcpy( data + 8, &v2, sizeof( uint32_t ) );
+}
+
+/*
+ * Each round depends on the one before, so a lone payload spends most of
+ * its time waiting on latency. Stepping several independent payloads
+ * together gives the CPU something to overlap.
+ */
+#define BTEA3_LANES 8
+
+static inline __attribute__(( always_inline )) void btea3_lanes( uint8_t * data, size_t stride, const btea3_schedule * ks, const int lanes )
+{
+    uint32_t v0[ BTEA3_LANES ];
+    uint32_t v1[ BTEA3_LANES ];
+    uint32_t v2[ BTEA3_LANES ];
+    uint32_t y;
+    uint32_t z;
+    uint32_t sum;
+    const uint32_t * key;
+    int q;
+    int j;
+
+    for( j = 0; j < lanes; j++ )
+    {
+        uint8_t * d = data + j * stride;
+        uint32_t w[3];
+
+        memcpy( w, d, sizeof( w ) );
+        #if( _BIG_ENDIAN )
+        swap_bytes( w, 3 );
+        #endif
+        v0[j] = w[0];
+        v1[j] = w[1];
+        v2[j] = w[2];
+    }
+
+    for( q = 0; q < BTEA3_ROUNDS; q++ )
+    {
+        sum = ks->sum[q];
+        key = ks->key[q];
+        for( j = 0; j < lanes; j++ )
+        {
+            z = v2[j]; y = v1[j]; z = v0[j] += MX3( 0 );
+            y = v2[j]; z = v1[j] += MX3( 1 );
+            y = v0[j]; z = v2[j] += MX3( 2 );
+        }
+    }
+
+    for( j = 0; j < lanes; j++ )
+    {
+        uint8_t * d = data + j * stride;
+        uint32_t w[3];
+
+        w[0] = v0[j];
+        w[1] = v1[j];
+        w[2] = v2[j];
+        #if( _BIG_ENDIAN )
+        swap_bytes( w, 3 );
+        #endif
+        memcpy( d, w, sizeof( w ) );
+    }
+}
+
+void btea3_schedule_init( btea3_schedule * ks, const uint32_t k[4] )
+{
+    uint32_t sum = 0;
+    uint32_t e;
+    int q;
+
+    for( q = 0; q < BTEA3_ROUNDS; q++ )
+    {
+        sum += BTEA_DELTA;
+        e = sum >> 2 & 3;
+        ks->sum[q]    = sum;
+        ks->key[q][0] = k[ 0 ^ e ];
+        ks->key[q][1] = k[ 1 ^ e ];
+        ks->key[q][2] = k[ 2 ^ e ];
+    }
+}
+
+void btea3_encrypt( uint32_t v[3], const uint32_t k[4] )
+{
+    btea3_schedule ks;
+
+    btea3_schedule_init( &ks, k );
+    btea3_block( (uint8_t*)v, &ks );
+}
+
+void btea3_encrypt_scheduled( uint32_t v[3], const btea3_schedule * ks )
+{
+    btea3_block( (uint8_t*)v, ks );
+}
+
+void btea3_encrypt_batch_scalar( void * v, size_t count, size_t stride, const btea3_schedule * ks )
+{
+    uint8_t * data = (uint8_t*)v;
+    size_t i;
+
+    if( stride == 0 )
+    {
+        stride = 3 * sizeof( uint32_t );
+    }
+    for( i = 0; i + BTEA3_LANES <= count; i += BTEA3_LANES )
+    {
+        btea3_lanes( data, stride, ks, BTEA3_LANES );
+        data += BTEA3_LANES * stride;
+    }
+    if( i + BTEA3_LANES / 2 <= count )
+    {
+        btea3_lanes( data, stride, ks, BTEA3_LANES / 2 );
+        data += BTEA3_LANES / 2 * stride;
+        i    += BTEA3_LANES / 2;
+    }
+    for( ; i < count; i++ )
+    {
+        btea3_block( data, ks );
+        data += stride;
+    }
+}
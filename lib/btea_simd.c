@@ -0,0 +1,302 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+/*
+ * btea3_encrypt_batch() with one payload per vector lane. Every payload
+ * shares the key schedule, which only depends on the round, so a round is
+ * the scalar round applied to whole registers: 4 lanes per register with
+ * SSE2, 8 with AVX2. Payloads are transposed into word-major registers
+ * on the way in and back on the way out; leftovers go to the next
+ * narrower kernel.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "btea.h"
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && \
+    ( defined( __clang__ ) || __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define BTEA3_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void ( * btea3_kernel )( uint8_t * data, size_t count, size_t stride, const btea3_schedule * ks );
+
+#ifdef BTEA3_X86
+
+/*
+ * A round is a chain of dependent steps, so each call steps groups
+ * independent registers side by side to keep the vector units busy.
+ */
+#define SSE2_MX( kv ) _mm_xor_si128( \
+    _mm_add_epi32( _mm_xor_si128( _mm_srli_epi32( z, 5 ), _mm_slli_epi32( y, 2 ) ), \
+                   _mm_xor_si128( _mm_srli_epi32( y, 3 ), _mm_slli_epi32( z, 4 ) ) ), \
+    _mm_add_epi32( _mm_xor_si128( s, y ), _mm_xor_si128( kv, z ) ) )
+
+__attribute__(( target( "sse2" ), always_inline ))
+static inline void sse2_groups( uint8_t * data, size_t stride, const btea3_schedule * ks, const int groups )
+{
+    uint32_t w[3][8] __attribute__(( aligned( 16 ) ));
+    __m128i  v0[2], v1[2], v2[2], y, z, s, k0, k1, k2;
+    int      q;
+    int      g;
+    int      j;
+
+    for( j = 0; j < 4 * groups; j++ )
+    {
+        memcpy( &w[0][j], data + j * stride,     sizeof( uint32_t ) );
+        memcpy( &w[1][j], data + j * stride + 4, sizeof( uint32_t ) );
+        memcpy( &w[2][j], data + j * stride + 8, sizeof( uint32_t ) );
+    }
+    for( g = 0; g < groups; g++ )
+    {
+        v0[g] = _mm_load_si128( (const __m128i*)&w[0][ 4 * g ] );
+        v1[g] = _mm_load_si128( (const __m128i*)&w[1][ 4 * g ] );
+        v2[g] = _mm_load_si128( (const __m128i*)&w[2][ 4 * g ] );
+    }
+
+    for( q = 0; q < BTEA3_ROUNDS; q++ )
+    {
+        s  = _mm_set1_epi32( (int)ks->sum[q] );
+        k0 = _mm_set1_epi32( (int)ks->key[q][0] );
+        k1 = _mm_set1_epi32( (int)ks->key[q][1] );
+        k2 = _mm_set1_epi32( (int)ks->key[q][2] );
+        for( g = 0; g < groups; g++ )
+        {
+            z = v2[g]; y = v1[g]; v0[g] = _mm_add_epi32( v0[g], SSE2_MX( k0 ) );
+            z = v0[g]; y = v2[g]; v1[g] = _mm_add_epi32( v1[g], SSE2_MX( k1 ) );
+            z = v1[g]; y = v0[g]; v2[g] = _mm_add_epi32( v2[g], SSE2_MX( k2 ) );
+        }
+    }
+
+    for( g = 0; g < groups; g++ )
+    {
+        _mm_store_si128( (__m128i*)&w[0][ 4 * g ], v0[g] );
+        _mm_store_si128( (__m128i*)&w[1][ 4 * g ], v1[g] );
+        _mm_store_si128( (__m128i*)&w[2][ 4 * g ], v2[g] );
+    }
+    for( j = 0; j < 4 * groups; j++ )
+    {
+        memcpy( data + j * stride,     &w[0][j], sizeof( uint32_t ) );
+        memcpy( data + j * stride + 4, &w[1][j], sizeof( uint32_t ) );
+        memcpy( data + j * stride + 8, &w[2][j], sizeof( uint32_t ) );
+    }
+}
+
+__attribute__(( target( "sse2" ) ))
+static void btea3_sse2( uint8_t * data, size_t count, size_t stride, const btea3_schedule * ks )
+{
+    size_t i;
+
+    for( i = 0; i + 8 <= count; i += 8 )
+    {
+        sse2_groups( data, stride, ks, 2 );
+        data += 8 * stride;
+    }
+    if( i + 4 <= count )
+    {
+        sse2_groups( data, stride, ks, 1 );
+        data += 4 * stride;
+        i    += 4;
+    }
+    btea3_encrypt_batch_scalar( data, count - i, stride, ks );
+}
+
+#define AVX2_MX( kv ) _mm256_xor_si256( \
+    _mm256_add_epi32( _mm256_xor_si256( _mm256_srli_epi32( z, 5 ), _mm256_slli_epi32( y, 2 ) ), \
+                      _mm256_xor_si256( _mm256_srli_epi32( y, 3 ), _mm256_slli_epi32( z, 4 ) ) ), \
+    _mm256_add_epi32( _mm256_xor_si256( s, y ), _mm256_xor_si256( kv, z ) ) )
+
+__attribute__(( target( "avx2" ), always_inline ))
+static inline void avx2_groups( uint8_t * data, size_t stride, const btea3_schedule * ks, const int groups )
+{
+    uint32_t w[3][16] __attribute__(( aligned( 32 ) ));
+    __m256i  v0[2], v1[2], v2[2], y, z, s, k0, k1, k2;
+    int      q;
+    int      g;
+    int      j;
+
+    for( j = 0; j < 8 * groups; j++ )
+    {
+        memcpy( &w[0][j], data + j * stride,     sizeof( uint32_t ) );
+        memcpy( &w[1][j], data + j * stride + 4, sizeof( uint32_t ) );
+        memcpy( &w[2][j], data + j * stride + 8, sizeof( uint32_t ) );
+    }
+    for( g = 0; g < groups; g++ )
+    {
+        v0[g] = _mm256_load_si256( (const __m256i*)&w[0][ 8 * g ] );
+        v1[g] = _mm256_load_si256( (const __m256i*)&w[1][ 8 * g ] );
+        v2[g] = _mm256_load_si256( (const __m256i*)&w[2][ 8 * g ] );
+    }
+
+    for( q = 0; q < BTEA3_ROUNDS; q++ )
+    {
+        s  = _mm256_set1_epi32( (int)ks->sum[q] );
+        k0 = _mm256_set1_epi32( (int)ks->key[q][0] );
+        k1 = _mm256_set1_epi32( (int)ks->key[q][1] );
+        k2 = _mm256_set1_epi32( (int)ks->key[q][2] );
+        for( g = 0; g < groups; g++ )
+        {
+            z = v2[g]; y = v1[g]; v0[g] = _mm256_add_epi32( v0[g], AVX2_MX( k0 ) );
+            z = v0[g]; y = v2[g]; v1[g] = _mm256_add_epi32( v1[g], AVX2_MX( k1 ) );
+            z = v1[g]; y = v0[g]; v2[g] = _mm256_add_epi32( v2[g], AVX2_MX( k2 ) );
+        }
+    }
+
+    for( g = 0; g < groups; g++ )
+    {
+        _mm256_store_si256( (__m256i*)&w[0][ 8 * g ], v0[g] );
+        _mm256_store_si256( (__m256i*)&w[1][ 8 * g ], v1[g] );
+        _mm256_store_si256( (__m256i*)&w[2][ 8 * g ], v2[g] );
+    }
+    for( j = 0; j < 8 * groups; j++ )
+    {
+        memcpy( data + j * stride,     &w[0][j], sizeof( uint32_t ) );
+        memcpy( data + j * stride + 4, &w[1][j], sizeof( uint32_t ) );
+        memcpy( data + j * stride + 8, &w[2][j], sizeof( uint32_t ) );
+    }
+}
+
+__attribute__(( target( "avx2" ) ))
+static void btea3_avx2( uint8_t * data, size_t count, size_t stride, const btea3_schedule * ks )
+{
+    size_t i;
+
+    for( i = 0; i + 16 <= count; i += 16 )
+    {
+        avx2_groups( data, stride, ks, 2 );
+        data += 16 * stride;
+    }
+    if( i + 8 <= count )
+    {
+        avx2_groups( data, stride, ks, 1 );
+        data += 8 * stride;
+        i    += 8;
+    }
+    btea3_sse2( data, count - i, stride, ks );
+}
+
+#endif
+
+static void btea3_scalar( uint8_t * data, size_t count, size_t stride, const btea3_schedule * ks )
+{
+    btea3_encrypt_batch_scalar( data, count, stride, ks );
+}
+
+static const char * const impl_names[ BTEA3_NUM_IMPLS ] = { "scalar", "sse2", "avx2" };
+
+static int selected = -1;
+
+int btea3_impl_supported( enum btea3_impl impl )
+{
+    switch( impl )
+    {
+        case BTEA3_SCALAR:
+            return 1;
+
+        #ifdef BTEA3_X86
+        case BTEA3_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "sse2" ) != 0;
+
+        case BTEA3_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "avx2" ) != 0;
+        #endif
+
+        default:
+            return 0;
+    }
+}
+
+int btea3_set_impl( enum btea3_impl impl )
+{
+    if( impl < 0 || impl >= BTEA3_NUM_IMPLS || !btea3_impl_supported( impl ) )
+    {
+        return 0;
+    }
+    __atomic_store_n( &selected, (int)impl, __ATOMIC_RELAXED );
+    return 1;
+}
+
+enum btea3_impl btea3_get_impl( void )
+{
+    int impl = __atomic_load_n( &selected, __ATOMIC_RELAXED );
+
+    if( impl < 0 )
+    {
+        impl = BTEA3_NUM_IMPLS - 1;
+        while( impl > BTEA3_SCALAR && !btea3_impl_supported( (enum btea3_impl)impl ) )
+        {
+            impl--;
+        }
+        __atomic_store_n( &selected, impl, __ATOMIC_RELAXED );
+    }
+    return (enum btea3_impl)impl;
+}
+
+const char * btea3_impl_name( enum btea3_impl impl )
+{
+    if( impl < 0 || impl >= BTEA3_NUM_IMPLS )
+    {
+        return "unknown";
+    }
+    return impl_names[ impl ];
+}
+
+void btea3_encrypt_batch( void * v, size_t count, size_t stride, const uint32_t k[4] )
+{
+    btea3_schedule ks;
+
+    btea3_schedule_init( &ks, k );
+    btea3_encrypt_batch_scheduled( v, count, stride, &ks );
+}
+
+void btea3_encrypt_batch_scheduled( void * v, size_t count, size_t stride, const btea3_schedule * ks )
+{
+    btea3_kernel kernel;
+
+    if( stride == 0 )
+    {
+        stride = 3 * sizeof( uint32_t );
+    }
+
+    switch( btea3_get_impl() )
+    {
+        #ifdef BTEA3_X86
+        case BTEA3_AVX2:
+            kernel = btea3_avx2;
+            break;
+
+        case BTEA3_SSE2:
+            kernel = btea3_sse2;
+            break;
+        #endif
+
+        default:
+            kernel = btea3_scalar;
+            break;
+    }
+    kernel( (uint8_t*)v, count, stride, ks );
+}
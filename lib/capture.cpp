@@ -0,0 +1,181 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "capture.hpp"
+#include "file_util.hpp"
+#include <cstring>
+
+using std::size_t;
+
+
+capture_writer::capture_writer()
+{
+    out  = NULL;
+    last = 0;
+}
+
+
+capture_writer::~capture_writer()
+{
+    close();
+}
+
+
+bool capture_writer::open( const std::string & filename, uint64_t now )
+{
+    uint8_t version[4];
+
+    close();
+    out = fopen( filename.c_str(), "wb" );
+    if( out == NULL )
+    {
+        return false;
+    }
+    put_le( version, CAPTURE_VERSION, 4 );
+    fwrite( CAPTURE_MAGIC, 1, 4, out );
+    fwrite( version, 1, 4, out );
+    last = now;
+    return true;
+}
+
+
+void capture_writer::close()
+{
+    if( out != NULL )
+    {
+        fclose( out );
+        out = NULL;
+    }
+}
+
+
+bool capture_writer::is_open() const
+{
+    return out != NULL;
+}
+
+
+void capture_writer::record( capture_dir dir, const uint8_t * data, size_t size, uint64_t now )
+{
+    uint8_t  head[7];
+    uint64_t delta = now > last ? now - last : 0;
+
+    //Nothing to write; keep the gap for the next record
+    if( out == NULL || size == 0 )
+    {
+        return;
+    }
+
+    while( delta > 0xFFFFFFFFull )
+    {
+        put_le( head, 0xFFFFFFFFul, 4 );
+        head[4] = dir;
+        put_le( head + 5, 0, 2 );
+        fwrite( head, 1, sizeof( head ), out );
+        delta -= 0xFFFFFFFFul;
+    }
+    while( size > 0 )
+    {
+        size_t chunk = size > 0xFFFF ? 0xFFFF : size;
+
+        put_le( head, delta, 4 );
+        head[4] = dir;
+        put_le( head + 5, chunk, 2 );
+        fwrite( head, 1, sizeof( head ), out );
+        fwrite( data, 1, chunk, out );
+        data  += chunk;
+        size  -= chunk;
+        delta  = 0;
+    }
+    last = now;
+}
+
+
+capture_reader::capture_reader()
+{
+    in   = NULL;
+    time = 0;
+}
+
+
+capture_reader::~capture_reader()
+{
+    close();
+}
+
+
+bool capture_reader::open( const std::string & filename )
+{
+    uint8_t head[8];
+
+    close();
+    in = fopen( filename.c_str(), "rb" );
+    if( in == NULL )
+    {
+        return false;
+    }
+    if( fread( head, 1, sizeof( head ), in ) != sizeof( head )
+        || memcmp( head, CAPTURE_MAGIC, 4 ) != 0
+        || get_le( head + 4, 4 ) != CAPTURE_VERSION )
+    {
+        close();
+        return false;
+    }
+    time = 0;
+    return true;
+}
+
+
+void capture_reader::close()
+{
+    if( in != NULL )
+    {
+        fclose( in );
+        in = NULL;
+    }
+}
+
+
+/* Fetch the next non-empty record, false at end of file */
+bool capture_reader::next( capture_record & rec )
+{
+    uint8_t head[7];
+    size_t  length;
+
+    while( in != NULL && fread( head, 1, sizeof( head ), in ) == sizeof( head ) )
+    {
+        time  += get_le( head, 4 );
+        length = get_le( head + 5, 2 );
+        if( length == 0 )
+        {
+            continue;
+        }
+
+        rec.time = time;
+        rec.dir  = head[4] == CAPTURE_RX ? CAPTURE_RX : CAPTURE_TX;
+        rec.data.resize( length );
+        return fread( &rec.data[0], 1, length, in ) == length;
+    }
+    return false;
+}
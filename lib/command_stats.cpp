@@ -0,0 +1,218 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "command_stats.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/time.h>
+#include <time.h>
+
+static const char * const stat_names[ NUM_STAT_TYPES ] =
+{
+    "move",
+    "line",
+    "curve",
+    "start",
+    "stop"
+};
+
+static int bucket_for( uint64_t ns )
+{
+    if( ns < HISTOGRAM_SUB )
+    {
+        return (int)ns;
+    }
+
+    int octave = 63 - __builtin_clzll( ns );
+    if( octave >= HISTOGRAM_OCTAVES )
+    {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    return ( octave - HISTOGRAM_SUB_BITS + 1 ) * HISTOGRAM_SUB +
+        (int)( ( ns >> ( octave - HISTOGRAM_SUB_BITS ) ) & ( HISTOGRAM_SUB - 1 ) );
+}
+
+
+/* Smallest value that lands in bucket i */
+static uint64_t bucket_low( int i )
+{
+    if( i < HISTOGRAM_SUB )
+    {
+        return i;
+    }
+
+    int shift = i / HISTOGRAM_SUB - 1;
+    return (uint64_t)( HISTOGRAM_SUB + i % HISTOGRAM_SUB ) << shift;
+}
+
+
+void latency_histogram::reset()
+{
+    memset( this, 0x00, sizeof( *this ) );
+}
+
+
+void latency_histogram::add( uint64_t ns )
+{
+    buckets[ bucket_for( ns ) ]++;
+
+    if( count == 0 || ns < min )
+    {
+        min = ns;
+    }
+    if( ns > max )
+    {
+        max = ns;
+    }
+    count++;
+    total += ns;
+}
+
+
+void latency_histogram::merge( const latency_histogram & other )
+{
+    if( other.count == 0 )
+    {
+        return;
+    }
+    for( int i = 0; i < HISTOGRAM_BUCKETS; ++i )
+    {
+        buckets[i] += other.buckets[i];
+    }
+    if( count == 0 || other.min < min )
+    {
+        min = other.min;
+    }
+    if( other.max > max )
+    {
+        max = other.max;
+    }
+    count += other.count;
+    total += other.total;
+}
+
+
+uint64_t latency_histogram::mean() const
+{
+    return count > 0 ? total / count : 0;
+}
+
+
+/* Interpolated within the bucket holding the p'th percentile */
+uint64_t latency_histogram::percentile( double p ) const
+{
+    uint64_t seen = 0;
+    uint64_t rank = (uint64_t)( p / 100.0 * count + 0.5 );
+
+    if( count == 0 )
+    {
+        return 0;
+    }
+    if( rank < 1 )
+    {
+        rank = 1;
+    }
+    for( int i = 0; i < HISTOGRAM_BUCKETS; ++i )
+    {
+        if( seen + buckets[i] >= rank )
+        {
+            uint64_t lo = bucket_low( i );
+            uint64_t hi = i == HISTOGRAM_BUCKETS - 1 ? max : bucket_low( i + 1 ) - 1;
+            uint64_t value = lo + ( hi - lo ) * ( rank - seen ) / buckets[i];
+
+            if( value < min )
+            {
+                value = min;
+            }
+            return value < max ? value : max;
+        }
+        seen += buckets[i];
+    }
+    return max;
+}
+
+
+void command_stats::reset()
+{
+    count    = 0;
+    bytes    = 0;
+    timeouts = 0;
+    dropped  = 0;
+    encode.reset();
+    write.reset();
+    ack.reset();
+}
+
+
+uint64_t stats_clock()
+{
+    #if( __linux )
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+    #else
+    timeval tv;
+    gettimeofday( &tv, NULL );
+    return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+    #endif
+}
+
+
+const char * stat_type_name( stat_type type )
+{
+    return type < NUM_STAT_TYPES ? stat_names[ type ] : "unknown";
+}
+
+
+void print_stats( std::ostream & out, const command_stats stats[ NUM_STAT_TYPES ] )
+{
+    char line[256];
+
+    snprintf( line, sizeof( line ), "%-6s %9s %10s %8s %8s %9s %9s %9s %9s %9s %9s\n",
+        "cmd", "count", "bytes", "timeouts", "dropped", "enc avg", "wr avg", "ack avg", "ack p50", "ack p99", "ack max" );
+    out << line;
+    for( int i = 0; i < NUM_STAT_TYPES; ++i )
+    {
+        const command_stats & s = stats[i];
+
+        if( s.count == 0 )
+        {
+            continue;
+        }
+        /* times in usecs */
+        snprintf( line, sizeof( line ), "%-6s %9llu %10llu %8llu %8llu %9.3f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+            stat_names[i],
+            (unsigned long long)s.count,
+            (unsigned long long)s.bytes,
+            (unsigned long long)s.timeouts,
+            (unsigned long long)s.dropped,
+            s.encode.mean() / 1000.0,
+            s.write.mean() / 1000.0,
+            s.ack.mean() / 1000.0,
+            s.ack.percentile( 50 ) / 1000.0,
+            s.ack.percentile( 99 ) / 1000.0,
+            s.ack.max / 1000.0 );
+        out << line;
+    }
+}
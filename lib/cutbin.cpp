@@ -0,0 +1,226 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "cutbin.hpp"
+#include "file_util.hpp"
+
+#define CUTBIN_MAGIC   "CBIN"
+#define CUTBIN_VERSION 1
+
+namespace Device
+{
+    static double distance( const ixy & a, const ixy & b )
+    {
+        double dx = (double)b.x - a.x;
+        double dy = (double)b.y - a.y;
+        return sqrt( dx * dx + dy * dy );
+    }
+
+    static void grow( cutbin_header & header, const ixy & pt )
+    {
+        header.min.x = pt.x < header.min.x ? pt.x : header.min.x;
+        header.min.y = pt.y < header.min.y ? pt.y : header.min.y;
+        header.max.x = pt.x > header.max.x ? pt.x : header.max.x;
+        header.max.y = pt.y > header.max.y ? pt.y : header.max.y;
+    }
+
+    bool is_cutbin( const std::string & file )
+    {
+        static const std::string ext = ".cutbin";
+
+        return file.size() > ext.size() && file.compare( file.size() - ext.size(), ext.size(), ext ) == 0;
+    }
+
+    uint64_t hash_file( const std::string & file )
+    {
+        FILE * in = fopen( file.c_str(), "rb" );
+        uint8_t buf[ 65536 ];
+        uint64_t hash = FNV1A_INIT;
+        std::size_t got;
+
+        if( in == NULL )
+        {
+            return 0;
+        }
+        while( ( got = fread( buf, 1, sizeof( buf ), in ) ) > 0 )
+        {
+            hash = fnv1a( buf, got, hash );
+        }
+        fclose( in );
+        return hash;
+    }
+
+    bool compile_cutbin( const std::string & file, C & device, const Recorder & recorder, uint64_t source_hash )
+    {
+        const std::vector<command> & cmds = recorder.get_commands();
+        std::vector<unit_command> units( cmds.size() );
+        C::encoded_job job;
+        cutbin_header header;
+        std::size_t count = 0;
+
+        for( std::size_t i = 0; i < cmds.size(); ++i )
+        {
+            units[i] = C::to_units( cmds[i] );
+        }
+        if( !units.empty() )
+        {
+            count = device.encode_job( &units[0], units.size(), job );
+        }
+
+        memset( header.profile, 0x00, sizeof( header.profile ) );
+        strncpy( header.profile, "Device C", sizeof( header.profile ) - 1 );
+        header.units_per_inch = C::UNITS_PER_INCH;
+        header.link_rate      = device.get_link_rate();
+        header.key_ids[0]     = device.key_id( STAT_MOVE );
+        header.key_ids[1]     = device.key_id( STAT_LINE );
+        header.key_ids[2]     = device.key_id( STAT_CURVE );
+        header.source_hash    = source_hash;
+        header.commands       = count;
+        header.frames         = job.frames.size();
+
+        /* Each command takes as long as its frames on the wire or the
+           head following its points, whichever is longer. Curves are
+           taken along their control polygon, which is never shorter. */
+        double secs = 0;
+        double wire = (double)sizeof( lmc_command ) * BITS_PER_BYTE / ( header.link_rate > 0 ? header.link_rate : LINK_RATE );
+        ixy at( 0, 0 );
+
+        header.min = at;
+        header.max = at;
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            int points = units[i].type == CMD_CURVE ? 4 : 1;
+            double path = 0;
+
+            for( int j = 0; j < points; ++j )
+            {
+                path += distance( at, units[i].pt[j] );
+                at = units[i].pt[j];
+                grow( header, at );
+            }
+            double motion = path / C::UNITS_PER_INCH / CUTBIN_INCHES_PER_SEC;
+            secs += motion > wire * points ? motion : wire * points;
+        }
+        header.estimated_ms = (uint32_t)( secs * 1000 + 0.5 );
+
+        if( count < cmds.size() )
+        {
+            std::cout << file << ": could only encode " << count << " of " << cmds.size() << " commands" << std::endl;
+        }
+        if( !save_cutbin( file, header, job ) )
+        {
+            perror( file.c_str() );
+            return false;
+        }
+
+        char line[ 256 ];
+        snprintf( line, sizeof( line ),
+            "compiled %u commands, %u frames to %s, %.1f x %.1f in, about %.1f s",
+            header.commands, header.frames, file.c_str(),
+            (double)( header.max.x - header.min.x ) / C::UNITS_PER_INCH,
+            (double)( header.max.y - header.min.y ) / C::UNITS_PER_INCH,
+            header.estimated_ms / 1000.0 );
+        std::cout << line << std::endl;
+        return count == cmds.size();
+    }
+
+    bool save_cutbin( const std::string & file, const cutbin_header & header, const C::encoded_job & job )
+    {
+        std::size_t frames = job.frames.size();
+        std::vector<uint8_t> buf( CUTBIN_HEADER_SIZE + frames * ( sizeof( lmc_command ) + 1 ) );
+        uint8_t * p = &buf[0];
+
+        memcpy( p, CUTBIN_MAGIC, 4 );
+        put_le( p + 4, CUTBIN_VERSION );
+        put_le( p + 8, CUTBIN_HEADER_SIZE );
+        memcpy( p + 12, header.profile, sizeof( header.profile ) );
+        put_le( p + 28, header.units_per_inch );
+        put_le( p + 32, header.link_rate );
+        put_le64( p + 36, header.key_ids[0] );
+        put_le64( p + 44, header.key_ids[1] );
+        put_le64( p + 52, header.key_ids[2] );
+        put_le64( p + 60, header.source_hash );
+        put_le( p + 68, (uint32_t)header.min.x );
+        put_le( p + 72, (uint32_t)header.min.y );
+        put_le( p + 76, (uint32_t)header.max.x );
+        put_le( p + 80, (uint32_t)header.max.y );
+        put_le( p + 84, header.estimated_ms );
+        put_le( p + 88, header.commands );
+        put_le( p + 92, frames );
+        p += CUTBIN_HEADER_SIZE;
+        if( frames > 0 )
+        {
+            memcpy( p, &job.frames[0], frames * sizeof( lmc_command ) );
+            p += frames * sizeof( lmc_command );
+        }
+        for( std::size_t i = 0; i < frames; ++i )
+        {
+            *p++ = job.types[i];
+        }
+        return replace_file( file, &buf[0], buf.size() );
+    }
+
+    bool parse_cutbin( const uint8_t * data, std::size_t size, cutbin_header & header )
+    {
+        if( size < CUTBIN_HEADER_SIZE || memcmp( data, CUTBIN_MAGIC, 4 ) != 0 ||
+            get_le( data + 4 ) != CUTBIN_VERSION || get_le( data + 8 ) != CUTBIN_HEADER_SIZE )
+        {
+            return false;
+        }
+
+        memcpy( header.profile, data + 12, sizeof( header.profile ) );
+        header.profile[ sizeof( header.profile ) - 1 ] = '\0';
+        header.units_per_inch = get_le( data + 28 );
+        header.link_rate      = get_le( data + 32 );
+        header.key_ids[0]     = get_le64( data + 36 );
+        header.key_ids[1]     = get_le64( data + 44 );
+        header.key_ids[2]     = get_le64( data + 52 );
+        header.source_hash    = get_le64( data + 60 );
+        header.min            = ixy( get_le( data + 68 ), get_le( data + 72 ) );
+        header.max            = ixy( get_le( data + 76 ), get_le( data + 80 ) );
+        header.estimated_ms   = get_le( data + 84 );
+        header.commands       = get_le( data + 88 );
+        header.frames         = get_le( data + 92 );
+
+        if( size - CUTBIN_HEADER_SIZE != (uint64_t)header.frames * ( sizeof( lmc_command ) + 1 ) )
+        {
+            return false;
+        }
+
+        const uint8_t * types = data + CUTBIN_HEADER_SIZE + (std::size_t)header.frames * sizeof( lmc_command );
+        for( uint32_t i = 0; i < header.frames; ++i )
+        {
+            if( types[i] > STAT_CURVE )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -1,13 +1,59 @@
 %module cutter
 %{
 #include "types.h"
+#include "btea.h"
+#include "transport.hpp"
+#include "link_rate.hpp"
+#include "realtime.hpp"
+#include "frame_cache.hpp"
 #include "device.hpp"
 #include "device_c.hpp"
+#include "device_filter.hpp"
+#include "device_recorder.hpp"
+#include "job_cache.hpp"
+#include "cutbin.hpp"
 %}
 %apply unsigned int { uint32_t }
+%include "stdint.i"
 %include "std_string.i"
+%include "std_vector.i"
 %include "carrays.i"
 %array_class(uint32_t, uint32Array)
+
+/* Raw buffer, stream and stride entry points have no use from Python */
+%ignore btea3_schedule::key;
+%ignore btea3_encrypt_batch;
+%ignore btea3_encrypt_batch_scheduled;
+%ignore btea3_encrypt_batch_scalar;
+%ignore io_chunk;
+%ignore transport::p_writev;
+%ignore print_realtime_report;
+%ignore prefault;
+%ignore print_cache_stats;
+%ignore fnv1a;
+%ignore Device::Filter::dump_stats;
+%ignore Device::job_cache::dump_stats;
+%ignore Device::parse_cutbin;
+
+/* Encoded jobs are only handed back to send_job() and save_job() */
+%ignore Device::C::encoded_job::frames;
+%ignore Device::C::encoded_job::types;
+%ignore Device::C::encoded_job::ends;
+%ignore Device::C::encoded_job::positions;
+%ignore Device::C::encode_frame;
+%ignore Device::C::send_frames;
+%ignore Device::C::dump_stats;
 %include "types.h"
+%include "btea.h"
+%include "transport.hpp"
+%include "link_rate.hpp"
+%include "realtime.hpp"
+%include "frame_cache.hpp"
 %include "device.hpp"
+%template(command_vector) std::vector<Device::command>;
+%template(unit_command_vector) std::vector<Device::unit_command>;
 %include "device_c.hpp"
+%include "device_filter.hpp"
+%include "device_recorder.hpp"
+%include "job_cache.hpp"
+%include "cutbin.hpp"
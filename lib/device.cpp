@@ -22,6 +22,8 @@
  * libcutter Developers @ Cowtown Computer Congress
  * 3101 Mercier Street #404, Kansas City, MO 64111
  */
+#include <stdint.h>
+#include <cfloat>
 #include "device.hpp"
 
 namespace Device
@@ -38,4 +40,99 @@ namespace Device
     Generic::~Generic()
     {
     }
+
+    /*
+     * Run a whole toolpath, returning how many commands completed before
+     * the first failure. Backends that can do better in bulk override this.
+     */
+    std::size_t Generic::submit( const command * cmds, std::size_t count )
+    {
+        std::size_t i;
+        bool ok = true;
+
+        for( i = 0; i < count && ok; ++i )
+        {
+            switch( cmds[i].type )
+            {
+                case CMD_MOVE:
+                    ok = move_to( cmds[i].pt[0] );
+                    break;
+
+                case CMD_CUT:
+                    ok = cut_to( cmds[i].pt[0] );
+                    break;
+
+                case CMD_CURVE:
+                    ok = curve_to( cmds[i].pt[0], cmds[i].pt[1], cmds[i].pt[2], cmds[i].pt[3] );
+                    break;
+
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+        return ok ? i : i - 1;
+    }
+
+    /*
+     * The same from device units, back through inches. Backends that
+     * work in units override this and skip the conversion.
+     */
+    std::size_t Generic::submit_units( const unit_command * cmds, std::size_t count )
+    {
+        int units = get_units_per_inch();
+        std::size_t i;
+
+        if( units <= 0 )
+        {
+            return 0;
+        }
+        for( i = 0; i < count; ++i )
+        {
+            command cmd;
+
+            cmd.type  = cmds[i].type;
+            cmd.pt[0] = from_units( cmds[i].pt[0], units );
+            if( cmd.type == CMD_CURVE )
+            {
+                cmd.pt[1] = from_units( cmds[i].pt[1], units );
+                cmd.pt[2] = from_units( cmds[i].pt[2], units );
+                cmd.pt[3] = from_units( cmds[i].pt[3], units );
+            }
+            if( submit( &cmd, 1 ) != 1 )
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+    int32_t round_units( double units )
+    {
+        //NaN gets past every comparison below; neither it nor an infinity
+        //is anywhere to cut to
+        if( units != units || units > DBL_MAX || units < -DBL_MAX )
+        {
+            return 0;
+        }
+        if( units >= INT32_MAX )
+        {
+            return INT32_MAX;
+        }
+        if( units <= INT32_MIN )
+        {
+            return INT32_MIN;
+        }
+        return (int32_t)( units < 0 ? units - 0.5 : units + 0.5 );
+    }
+
+    ixy to_units( const xy &pt, int units_per_inch )
+    {
+        return ixy( round_units( pt.x * units_per_inch ), round_units( pt.y * units_per_inch ) );
+    }
+
+    xy from_units( const ixy &pt, int units_per_inch )
+    {
+        return xy( pt.x / (double)units_per_inch, pt.y / (double)units_per_inch );
+    }
 }
@@ -25,124 +25,1249 @@
 #include <string>
 #include <cstdlib>
 #include <iostream>
-#include <assert.h>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
 #include "btea.h"
 #include "device_c.hpp"
 
-static inline uint32_t htocl( const uint32_t input );
-
-struct __attribute__(( packed )) lmc_command
-{
-    uint8_t  bytes;
-    uint8_t  cmd;
-    uint32_t data[3];
-};
-
 namespace Device
 {
     static const int DELAY = 170000;
-    static const float INCHES_TO_C_UNITS = 404.0f;
-    static const float C_UNITS_TO_INCHES = ( 1 / (INCHES_TO_C_UNITS) );
+    static const int ACK_TIMEOUT = 10000;
+    static const int ACK_RETRIES = 0;
+    static const int CALIBRATE_ACK_TIMEOUT = 200;
+    static const int IO_IDLE_USECS = 100;
+    static const std::size_t ENCODE_CHUNK = 1024;
 
     static const uint8_t cmd_stop[] ={0x04, 0x22, 0x00, 0x00, 0x00 };
     static const uint8_t cmd_start[]={0x04, 0x21, 0x00, 0x00, 0x00 };
 
     C::C()
-        : m_serial()
+        : m_serial(),
+        m_port( &m_serial ),
+        m_ack_timeout( ACK_TIMEOUT ),
+        m_ack_retries( ACK_RETRIES ),
+        m_ack_status( transport::READ_OK ),
+        m_position( 0, 0 ),
+        m_window( 1 ),
+        m_max_coalesce( 1 ),
+        m_pending_head( 0 ),
+        m_pending_count( 0 ),
+        m_stats_enabled( false ),
+        m_io_ring( NULL ),
+        m_io_run( false ),
+        m_io_error( false ),
+        m_io_reset( false ),
+        m_io_pending( 0 ),
+        m_io_started( false )
     {
+        memset( &m_rt_report, 0x00, sizeof( m_rt_report ) );
+        //Keys are hashed by key_id() whether or not they have been set
+        memset( &m_move_key, 0x00, sizeof( m_move_key ) );
+        memset( &m_line_key, 0x00, sizeof( m_line_key ) );
+        memset( &m_curve_key, 0x00, sizeof( m_curve_key ) );
+        reset_stats();
     }
 
     C::C( const std::string filename )
-        : m_serial()
+        : m_serial(),
+        m_port( &m_serial ),
+        m_ack_timeout( ACK_TIMEOUT ),
+        m_ack_retries( ACK_RETRIES ),
+        m_ack_status( transport::READ_OK ),
+        m_position( 0, 0 ),
+        m_window( 1 ),
+        m_max_coalesce( 1 ),
+        m_pending_head( 0 ),
+        m_pending_count( 0 ),
+        m_stats_enabled( false ),
+        m_io_ring( NULL ),
+        m_io_run( false ),
+        m_io_error( false ),
+        m_io_reset( false ),
+        m_io_pending( 0 ),
+        m_io_started( false )
     {
+        memset( &m_rt_report, 0x00, sizeof( m_rt_report ) );
+        //Keys are hashed by key_id() whether or not they have been set
+        memset( &m_move_key, 0x00, sizeof( m_move_key ) );
+        memset( &m_line_key, 0x00, sizeof( m_line_key ) );
+        memset( &m_curve_key, 0x00, sizeof( m_curve_key ) );
+        reset_stats();
         init( filename );
     }
 
     C::~C()
     {
+        stop_io_thread();
     }
 
     void C::init( const std::string filename )
     {
         m_serial.p_open( filename );
+        m_port = &m_serial;
+    }
+
+    ixy C::to_units( const xy &pt )
+    {
+        return Device::to_units( pt, UNITS_PER_INCH );
+    }
+
+    xy C::from_units( const ixy &pt )
+    {
+        return Device::from_units( pt, UNITS_PER_INCH );
     }
 
     bool C::move_to( const xy &pt )
     {
-        return do_command( pt, m_move_key );
+        return do_command( to_units( pt ), m_move_key, STAT_MOVE );
     }
 
     bool C::cut_to( const xy &pt )
     {
-        return do_command( pt, m_line_key );
+        return do_command( to_units( pt ), m_line_key, STAT_LINE );
     }
 
     bool C::curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 )
     {
-        if( !do_command( p0, m_curve_key ) )
+        return curve_to_units( to_units( p0 ), to_units( p1 ), to_units( p2 ), to_units( p3 ) );
+    }
+
+    bool C::move_to_units( const ixy &pt )
+    {
+        return do_command( pt, m_move_key, STAT_MOVE );
+    }
+
+    bool C::cut_to_units( const ixy &pt )
+    {
+        return do_command( pt, m_line_key, STAT_LINE );
+    }
+
+    bool C::curve_to_units( const ixy &p0, const ixy &p1, const ixy &p2, const ixy &p3 )
+    {
+        static const stat_type types[4] = { STAT_CURVE, STAT_CURVE, STAT_CURVE, STAT_CURVE };
+        lmc_command frames[4];
+
+        if( m_frame_cache.enabled() )
+        {
+            encode( p0, m_curve_key, frames[0], STAT_CURVE );
+            encode( p1, m_curve_key, frames[1], STAT_CURVE );
+            encode( p2, m_curve_key, frames[2], STAT_CURVE );
+            encode( p3, m_curve_key, frames[3], STAT_CURVE );
+        }
+        else
+        {
+            fill_frame( p0, frames[0] );
+            fill_frame( p1, frames[1] );
+            fill_frame( p2, frames[2] );
+            fill_frame( p3, frames[3] );
+            encrypt_frames( frames, 4, m_curve_key, STAT_CURVE );
+        }
+        if( send_frames( frames, types, 4 ) != 4 )
         {
             return false;
         }
-        if( !do_command( p1, m_curve_key ) )
+        m_position = p3;
+        return true;
+    }
+
+    unit_command C::to_units( const command &cmd )
+    {
+        unit_command u;
+
+        u.type = cmd.type;
+        u.pt[0] = to_units( cmd.pt[0] );
+        if( cmd.type == CMD_CURVE )
+        {
+            u.pt[1] = to_units( cmd.pt[1] );
+            u.pt[2] = to_units( cmd.pt[2] );
+            u.pt[3] = to_units( cmd.pt[3] );
+        }
+        return u;
+    }
+
+    std::size_t C::submit( const command * cmds, std::size_t count )
+    {
+        static const std::size_t CHUNK = 64;
+        unit_command units[ CHUNK ];
+        std::size_t done = 0;
+
+        while( done < count )
+        {
+            std::size_t n = count - done < CHUNK ? count - done : CHUNK;
+            std::size_t sent;
+
+            for( std::size_t i = 0; i < n; ++i )
+            {
+                units[i] = to_units( cmds[ done + i ] );
+            }
+            sent = submit_units( units, n );
+            done += sent;
+            if( sent < n )
+            {
+                break;
+            }
+        }
+        return done;
+    }
+
+    /*
+     * Encode a chunk of the toolpath up front, then stream its frames so
+     * the send loop only does I/O.
+     */
+    std::size_t C::submit_units( const unit_command * cmds, std::size_t count )
+    {
+        static const std::size_t CHUNK = 64;
+        lmc_command frames[ CHUNK * 4 ];
+        stat_type types[ CHUNK * 4 ];
+        std::size_t ends[ CHUNK ];
+        std::size_t done = 0;
+
+        while( done < count )
+        {
+            std::size_t n = count - done < CHUNK ? count - done : CHUNK;
+            std::size_t f = 0;
+            std::size_t sent = 0;
+            std::size_t i;
+            bool valid = true;
+
+            for( i = 0; i < n && valid; ++i )
+            {
+                const unit_command & cmd = cmds[ done + i ];
+                switch( cmd.type )
+                {
+                    case CMD_MOVE:
+                        types[f] = STAT_MOVE;
+                        fill_frame( cmd.pt[0], frames[ f++ ] );
+                        break;
+
+                    case CMD_CUT:
+                        types[f] = STAT_LINE;
+                        fill_frame( cmd.pt[0], frames[ f++ ] );
+                        break;
+
+                    case CMD_CURVE:
+                        for( int j = 0; j < 4; ++j )
+                        {
+                            types[f] = STAT_CURVE;
+                            fill_frame( cmd.pt[j], frames[ f++ ] );
+                        }
+                        break;
+
+                    default:
+                        valid = false;
+                        break;
+                }
+                ends[i] = f;
+            }
+            if( !valid )
+            {
+                n = i - 1;
+            }
+
+            //Encrypt each run of same-key frames in one batch
+            std::size_t run = 0;
+            std::size_t total = n > 0 ? ends[ n - 1 ] : 0;
+            while( run < total )
+            {
+                std::size_t len = 1;
+                while( run + len < total && types[ run + len ] == types[ run ] )
+                {
+                    len++;
+                }
+                encrypt_frames( frames + run, len, key_for( types[ run ] ), types[ run ] );
+                run += len;
+            }
+
+            if( n > 0 )
+            {
+                sent = send_frames( frames, types, ends[ n - 1 ] );
+            }
+            for( i = 0; i < n && ends[i] <= sent; ++i )
+            {
+                const unit_command & cmd = cmds[ done + i ];
+                m_position = cmd.pt[ cmd.type == CMD_CURVE ? 3 : 0 ];
+            }
+            if( i < n )
+            {
+                return done + i;
+            }
+            done += n;
+            if( !valid )
+            {
+                break;
+            }
+        }
+        return done;
+    }
+
+    /*
+     * Lay out every command's frames in one pass, then let the workers
+     * fill and encrypt them a chunk of commands at a time. Each chunk owns
+     * a disjoint slice of the frame buffer, so the workers share nothing
+     * but the counter handing chunks out.
+     */
+    struct encode_work
+    {
+        const C * device;
+        const unit_command * cmds;
+        C::encoded_job * job;
+        std::size_t count;
+        std::size_t next;
+        uint64_t busy;
+    };
+
+    std::size_t C::encode_job( const command * cmds, std::size_t count, encoded_job & job, int threads )
+    {
+        std::vector<unit_command> units( count );
+
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            units[i] = to_units( cmds[i] );
+        }
+        return encode_job( count > 0 ? &units[0] : NULL, count, job, threads );
+    }
+
+    std::size_t C::encode_job( const unit_command * cmds, std::size_t count, encoded_job & job, int threads )
+    {
+        std::size_t frames = 0;
+        std::size_t i;
+
+        job.ends.resize( count );
+        job.positions.resize( count );
+        for( i = 0; i < count; ++i )
+        {
+            const unit_command & cmd = cmds[i];
+
+            if( cmd.type == CMD_CURVE )
+            {
+                frames += 4;
+                job.positions[i] = cmd.pt[3];
+            }
+            else if( cmd.type == CMD_MOVE || cmd.type == CMD_CUT )
+            {
+                frames++;
+                job.positions[i] = cmd.pt[0];
+            }
+            else
+            {
+                break;
+            }
+            job.ends[i] = frames;
+        }
+        count = i;
+        job.ends.resize( count );
+        job.positions.resize( count );
+        job.frames.resize( frames );
+        job.types.resize( frames );
+
+        if( threads <= 0 )
+        {
+            #ifdef _SC_NPROCESSORS_ONLN
+            threads = sysconf( _SC_NPROCESSORS_ONLN );
+            #endif
+        }
+        if( threads > (int)( ( count + ENCODE_CHUNK - 1 ) / ENCODE_CHUNK ) )
+        {
+            threads = ( count + ENCODE_CHUNK - 1 ) / ENCODE_CHUNK;
+        }
+
+        encode_work work;
+        std::vector<pthread_t> workers;
+
+        work.device = this;
+        work.cmds   = cmds;
+        work.job    = &job;
+        work.count  = count;
+        work.next   = 0;
+        work.busy   = 0;
+        for( int t = 1; t < threads; ++t )
+        {
+            pthread_t worker;
+            if( pthread_create( &worker, NULL, encode_worker, &work ) != 0 )
+            {
+                break;
+            }
+            workers.push_back( worker );
+        }
+        //This thread works too, and finishes alone if no worker started
+        encode_worker( &work );
+        for( i = 0; i < workers.size(); ++i )
+        {
+            pthread_join( workers[i], NULL );
+        }
+
+        if( stats_on() && frames > 0 )
+        {
+            uint64_t each = work.busy / frames;
+            for( i = 0; i < frames; ++i )
+            {
+                m_stats[ job.types[i] ].encode.add( each );
+            }
+        }
+        return count;
+    }
+
+    void * C::encode_worker( void * arg )
+    {
+        encode_work * work = (encode_work*)arg;
+        uint64_t begin = stats_clock();
+
+        for( ;; )
+        {
+            std::size_t first = __atomic_fetch_add( &work->next, ENCODE_CHUNK, __ATOMIC_RELAXED );
+            if( first >= work->count )
+            {
+                break;
+            }
+            std::size_t last = std::min( first + ENCODE_CHUNK, work->count );
+            work->device->encode_range( work->cmds, first, last, *work->job );
+        }
+        __atomic_fetch_add( &work->busy, stats_clock() - begin, __ATOMIC_RELAXED );
+        return NULL;
+    }
+
+    void C::encode_range( const unit_command * cmds, std::size_t begin, std::size_t end, encoded_job & job ) const
+    {
+        std::size_t first = begin > 0 ? job.ends[ begin - 1 ] : 0;
+        std::size_t f = first;
+
+        for( std::size_t i = begin; i < end; ++i )
+        {
+            const unit_command & cmd = cmds[i];
+            switch( cmd.type )
+            {
+                case CMD_MOVE:
+                    job.types[f] = STAT_MOVE;
+                    fill_frame( cmd.pt[0], job.frames[ f++ ] );
+                    break;
+
+                case CMD_CUT:
+                    job.types[f] = STAT_LINE;
+                    fill_frame( cmd.pt[0], job.frames[ f++ ] );
+                    break;
+
+                default:
+                    for( int j = 0; j < 4; ++j )
+                    {
+                        job.types[f] = STAT_CURVE;
+                        fill_frame( cmd.pt[j], job.frames[ f++ ] );
+                    }
+                    break;
+            }
+        }
+
+        while( first < f )
+        {
+            std::size_t len = 1;
+            while( first + len < f && job.types[ first + len ] == job.types[ first ] )
+            {
+                len++;
+            }
+            btea3_encrypt_batch_scheduled( job.frames[ first ].data, len, sizeof( lmc_command ), &key_for( job.types[ first ] ) );
+            first += len;
+        }
+    }
+
+    std::size_t C::send_job( const encoded_job & job, std::size_t first )
+    {
+        std::size_t count = job.ends.size();
+
+        if( first >= count )
+        {
+            return 0;
+        }
+
+        std::size_t begin = first > 0 ? job.ends[ first - 1 ] : 0;
+        std::size_t sent  = send_frames( &job.frames[ begin ], &job.types[ begin ], job.ends[ count - 1 ] - begin );
+        //Commands whose frames all went out
+        std::size_t done  = std::upper_bound( job.ends.begin() + first, job.ends.end(), begin + sent ) - job.ends.begin();
+
+        if( done > first )
+        {
+            m_position = job.positions[ done - 1 ];
+        }
+        return done - first;
+    }
+
+    bool C::start()
+    {
+        if( !wait_idle() )
         {
             return false;
         }
-        if( !do_command( p2, m_curve_key ) )
+        m_port->delay(DELAY);
+        return transmit( cmd_start, sizeof( cmd_start ), STAT_START );
+    }
+
+    bool C::stop()
+    {
+        bool ret;
+
+        wait_idle();
+        m_port->delay(DELAY);
+        ret = transmit( cmd_stop, sizeof( cmd_stop ), STAT_STOP );
+        if( stats_on() )
+        {
+            dump_stats( std::cout );
+        }
+        return ret;
+    }
+
+    bool C::do_command( const ixy &pt, const btea3_schedule &ks, stat_type type )
+    {
+        lmc_command l;
+
+        encode( pt, ks, l, type );
+        if( !send_frame( l, type ) )
         {
             return false;
         }
-        if( !do_command( p3, m_curve_key ) )
+        m_position = pt;
+        return true;
+    }
+
+    void C::encode( const ixy &pt, const btea3_schedule &ks, lmc_command &l, stat_type type )
+    {
+        uint64_t begin = stats_on() ? stats_clock() : 0;
+
+        if( m_frame_cache.lookup( type, pt, l ) )
+        {
+            if( stats_on() )
+            {
+                m_stats[ type ].encode.add( stats_clock() - begin );
+            }
+            return;
+        }
+        fill_frame( pt, l );
+        encrypt_frames( &l, 1, ks, type );
+        m_frame_cache.insert( type, pt, l );
+    }
+
+    void C::fill_frame( const ixy &pt, lmc_command &l ) const
+    {
+        l.bytes  =13;
+        l.cmd    = 0x40;
+        l.data[0]=htocl( get_rand() );
+        l.data[1]=htocl( (uint32_t)pt.y );
+        l.data[2]=htocl( (uint32_t)pt.x );
+    }
+
+    void C::encrypt_frames( lmc_command * l, std::size_t count, const btea3_schedule &ks, stat_type type )
+    {
+        uint64_t begin = stats_on() ? stats_clock() : 0;
+
+        btea3_encrypt_batch_scheduled( l[0].data, count, sizeof( lmc_command ), &ks );
+
+        if( stats_on() )
+        {
+            uint64_t each = ( stats_clock() - begin ) / count;
+            for( std::size_t i = 0; i < count; ++i )
+            {
+                m_stats[ type ].encode.add( each );
+            }
+        }
+    }
+
+    uint64_t C::key_id() const
+    {
+        uint64_t id = fnv1a( &m_move_key, sizeof( m_move_key ) );
+
+        id = fnv1a( &m_line_key, sizeof( m_line_key ), id );
+        return fnv1a( &m_curve_key, sizeof( m_curve_key ), id );
+    }
+
+    uint64_t C::key_id( stat_type type ) const
+    {
+        return fnv1a( &key_for( type ), sizeof( btea3_schedule ) );
+    }
+
+    const btea3_schedule & C::key_for( stat_type type ) const
+    {
+        switch( type )
+        {
+            case STAT_MOVE:
+                return m_move_key;
+
+            case STAT_LINE:
+                return m_line_key;
+
+            default:
+                return m_curve_key;
+        }
+    }
+
+    void C::encode_frame( const xy &pt, command_type type, lmc_command &l )
+    {
+        encode_frame( to_units( pt ), type, l );
+    }
+
+    void C::encode_frame( const ixy &pt, command_type type, lmc_command &l )
+    {
+        switch( type )
+        {
+            case CMD_MOVE:
+                encode( pt, m_move_key, l, STAT_MOVE );
+                break;
+
+            case CMD_CUT:
+                encode( pt, m_line_key, l, STAT_LINE );
+                break;
+
+            default:
+                encode( pt, m_curve_key, l, STAT_CURVE );
+                break;
+        }
+    }
+
+    bool C::transmit( const uint8_t * data, std::size_t size, stat_type type )
+    {
+        uint64_t begin = stats_on() ? stats_clock() : 0;
+        std::size_t written = m_port->p_write( data, size );
+
+        if( stats_on() )
+        {
+            m_stats[ type ].write.add( stats_clock() - begin );
+            m_stats[ type ].count++;
+            m_stats[ type ].bytes += written;
+        }
+        if( written != size )
         {
+            __atomic_store_n( &m_ack_status, transport::READ_ERROR, __ATOMIC_RELAXED );
             return false;
         }
         return true;
     }
 
-    bool C::start()
+    bool C::send_frame( const lmc_command &l, stat_type type )
     {
-        m_serial.delay(DELAY);
-        return m_serial.p_write( cmd_start, sizeof( cmd_start ) );
+        if( m_io_ring != NULL )
+        {
+            return queue_frame( l, type );
+        }
+        return write_frame( l, type );
     }
 
-    bool C::stop()
+    bool C::write_frame( const lmc_command &l, stat_type type )
     {
-        m_serial.delay(DELAY);
-        return m_serial.p_write( cmd_stop, sizeof( cmd_stop ) );
+        uint64_t sent;
+
+        if( m_window > 1 )
+        {
+            io_chunk chunk;
+
+            chunk.data = (const uint8_t*)&l;
+            chunk.size = sizeof( l );
+            return write_frames( &chunk, &type, 1 );
+        }
+
+        /* Coordinates are absolute, so resending a move or line whose ack
+           was lost at worst repeats it to where the head already is. A
+           curve is four frames in a row, though, and a resent control
+           point would shift every curve after it: those are never resent. */
+        int retries = type == STAT_CURVE ? 0 : m_ack_retries;
+
+        for( int attempt = 0; attempt <= retries; ++attempt )
+        {
+            if( !transmit( (const uint8_t*)&l, sizeof( l ), type ) )
+            {
+                return false;
+            }
+            sent = stats_on() ? stats_clock() : 0;
+            if( wait_ack() )
+            {
+                if( stats_on() )
+                {
+                    m_stats[ type ].ack.add( stats_clock() - sent );
+                }
+                return true;
+            }
+            if( m_ack_status != transport::READ_TIMEOUT )
+            {
+                break;
+            }
+            if( stats_on() )
+            {
+                m_stats[ type ].timeouts++;
+            }
+            m_port->flush_input();
+        }
+        //It went out but was never acked
+        if( stats_on() )
+        {
+            m_stats[ type ].dropped++;
+        }
+        __atomic_fetch_add( &m_unacked, (uint64_t)1, __ATOMIC_RELAXED );
+        return false;
     }
 
-    xy C::convert_to_internal( const xy &input )
+    /*
+     * Send one frame per chunk in a single write, taking a window slot
+     * for each, so this is only used with a window above 1. Chunks that
+     * sit next to each other in memory go out as one plain write.
+     */
+    bool C::write_frames( const io_chunk * chunks, const stat_type * types, std::size_t count )
     {
-        xy buf;
-        buf.x = INCHES_TO_C_UNITS * input.x;
-        buf.y = INCHES_TO_C_UNITS * input.y;
-        return buf;
+        uint64_t begin;
+        uint64_t sent;
+        std::size_t size = 0;
+        std::size_t written;
+        bool contiguous = true;
+
+        while( m_pending_count + (int)count > m_window )
+        {
+            if( !reap_ack() )
+            {
+                return false;
+            }
+        }
+
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            if( i > 0 && chunks[i].data != chunks[i-1].data + chunks[i-1].size )
+            {
+                contiguous = false;
+            }
+            size += chunks[i].size;
+        }
+
+        begin   = stats_on() ? stats_clock() : 0;
+        written = contiguous ? m_port->p_write( chunks[0].data, size ) : m_port->p_writev( chunks, count );
+        sent    = stats_on() ? stats_clock() : 0;
+
+        if( stats_on() )
+        {
+            for( std::size_t i = 0; i < count; ++i )
+            {
+                m_stats[ types[i] ].write.add( ( sent - begin ) / count );
+                m_stats[ types[i] ].count++;
+                m_stats[ types[i] ].bytes += chunks[i].size;
+            }
+        }
+        //Every frame that made it out whole will be acked, even after a short write
+        for( std::size_t i = 0, end = 0; i < count; ++i )
+        {
+            end += chunks[i].size;
+            if( end > written )
+            {
+                break;
+            }
+            pending_ack & p = m_pending[ ( m_pending_head + m_pending_count ) % MAX_WINDOW ];
+            p.sent = sent;
+            p.type = types[i];
+            m_pending_count++;
+        }
+        if( written != size )
+        {
+            __atomic_store_n( &m_ack_status, transport::READ_ERROR, __ATOMIC_RELAXED );
+            return false;
+        }
+        return true;
+    }
+
+    /* How many of the next frames may share one write */
+    std::size_t C::coalesce( std::size_t available ) const
+    {
+        std::size_t n = available;
+
+        if( m_window <= 1 )
+        {
+            return 1;
+        }
+        if( n > (std::size_t)m_max_coalesce )
+        {
+            n = m_max_coalesce;
+        }
+        if( n > (std::size_t)m_window )
+        {
+            n = m_window;
+        }
+        return n > 0 ? n : 1;
+    }
+
+    /* Returns how many frames were sent before the first failure */
+    std::size_t C::send_frames( const lmc_command * l, const stat_type * types, std::size_t count )
+    {
+        io_chunk chunks[ MAX_WINDOW ];
+        std::size_t sent = 0;
+
+        while( sent < count )
+        {
+            std::size_t n = coalesce( count - sent );
+
+            if( m_io_ring != NULL || n == 1 )
+            {
+                if( !send_frame( l[ sent ], types[ sent ] ) )
+                {
+                    break;
+                }
+                sent++;
+                continue;
+            }
+            for( std::size_t i = 0; i < n; ++i )
+            {
+                chunks[i].data = (const uint8_t*)&l[ sent + i ];
+                chunks[i].size = sizeof( lmc_command );
+            }
+            if( !write_frames( chunks, types + sent, n ) )
+            {
+                break;
+            }
+            sent += n;
+        }
+        return sent;
     }
 
-    bool C::do_command( const xy &pt, const ckey_type k )
+    bool C::wait_ack()
     {
         uint8_t rbuf[5];
-        xy ptbuffer = convert_to_internal( pt );
+        size_t num_chars;
+
+        __atomic_store_n( &m_ack_status, m_port->p_read_timed( rbuf, sizeof( rbuf ), m_ack_timeout, num_chars ), __ATOMIC_RELAXED );
+        if( m_ack_status != transport::READ_OK )
+        {
+            std::cout << "expected 5, got " << num_chars
+                << ( m_ack_status == transport::READ_TIMEOUT ? " (timed out)" : " (read error)" ) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Collect the ack for the oldest command in flight. Acks carry no
+     * sequence number, so once one goes missing we can no longer tell
+     * which command it belonged to: drop everything outstanding.
+     */
+    bool C::reap_ack()
+    {
+        const pending_ack & p = m_pending[ m_pending_head ];
+
+        if( !wait_ack() )
+        {
+            if( stats_on() && m_ack_status == transport::READ_TIMEOUT )
+            {
+                m_stats[ p.type ].timeouts++;
+            }
+            drop_pending();
+            return false;
+        }
+        if( stats_on() )
+        {
+            m_stats[ p.type ].ack.add( stats_clock() - p.sent );
+        }
+        m_pending_head = ( m_pending_head + 1 ) % MAX_WINDOW;
+        m_pending_count--;
+        return true;
+    }
+
+    /* Acks arrive in order, so once one is missing nothing behind it
+       can be matched up any more: give up on the whole window */
+    std::size_t C::drop_pending()
+    {
+        std::size_t dropped = m_pending_count;
+
+        if( stats_on() )
+        {
+            for( int i = 0; i < m_pending_count; ++i )
+            {
+                m_stats[ m_pending[ ( m_pending_head + i ) % MAX_WINDOW ].type ].dropped++;
+            }
+        }
+        __atomic_fetch_add( &m_unacked, (uint64_t)dropped, __ATOMIC_RELAXED );
+        m_port->flush_input();
+        m_pending_head  = 0;
+        m_pending_count = 0;
+        return dropped;
+    }
+
+    /* With the I/O thread running, wait until it has nothing left to
+       do or has stopped on an error; either way it is not touching
+       the port or the stats any more. */
+    void C::io_settle()
+    {
+        if( m_io_ring == NULL )
+        {
+            return;
+        }
+        while( !__atomic_load_n( &m_io_error, __ATOMIC_ACQUIRE ) &&
+            ( m_io_ring->count() > 0 || __atomic_load_n( &m_io_pending, __ATOMIC_ACQUIRE ) > 0 ) )
+        {
+            usleep( IO_IDLE_USECS );
+        }
+    }
+
+    bool C::wait_idle()
+    {
+        if( m_io_ring != NULL )
+        {
+            io_settle();
+            if( !__atomic_load_n( &m_io_error, __ATOMIC_ACQUIRE ) )
+            {
+                return true;
+            }
+            //Have the thread count what it never sent, and carry on
+            __atomic_store_n( &m_io_reset, true, __ATOMIC_RELEASE );
+            while( __atomic_load_n( &m_io_error, __ATOMIC_ACQUIRE ) )
+            {
+                usleep( IO_IDLE_USECS );
+            }
+            return false;
+        }
+        while( m_pending_count > 0 )
+        {
+            if( !reap_ack() )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool C::start_io_thread( std::size_t ring_size )
+    {
+        if( m_io_ring != NULL )
+        {
+            return true;
+        }
+        if( !wait_idle() )
+        {
+            return false;
+        }
+        m_io_ring    = new spsc_ring<io_frame>( ring_size );
+        m_io_run     = true;
+        m_io_error   = false;
+        m_io_reset   = false;
+        m_io_pending = 0;
+        m_io_started = false;
+        if( pthread_create( &m_io_thread, NULL, io_thread, this ) != 0 )
+        {
+            std::cout << "could not start I/O thread" << std::endl;
+            delete m_io_ring;
+            m_io_ring = NULL;
+            return false;
+        }
+        //Report on the real-time settings once the thread has tried them
+        while( !__atomic_load_n( &m_io_started, __ATOMIC_ACQUIRE ) )
+        {
+            usleep( IO_IDLE_USECS );
+        }
+        if( m_rt_config.requested() )
+        {
+            print_realtime_report( std::cout, m_rt_config, m_rt_report );
+        }
+        return true;
+    }
+
+    void C::stop_io_thread()
+    {
+        if( m_io_ring == NULL )
+        {
+            return;
+        }
+        __atomic_store_n( &m_io_run, false, __ATOMIC_RELEASE );
+        pthread_join( m_io_thread, NULL );
+        delete m_io_ring;
+        m_io_ring = NULL;
+    }
+
+    void * C::io_thread( void * arg )
+    {
+        C * self = (C*)arg;
+
+        if( self->m_rt_config.requested() )
+        {
+            enter_realtime( self->m_rt_config, self->m_rt_report );
+        }
+        __atomic_store_n( &self->m_io_started, true, __ATOMIC_RELEASE );
+        self->io_loop();
+        return NULL;
+    }
+
+    /*
+     * The frame at the head of the ring stays there until it has been
+     * written, so an empty ring plus nothing in flight means idle.
+     */
+    void C::io_loop()
+    {
+        io_chunk  chunks[ MAX_WINDOW ];
+        stat_type types[ MAX_WINDOW ];
+        io_frame  done;
+
+        while( true )
+        {
+            bool run = __atomic_load_n( &m_io_run, __ATOMIC_ACQUIRE );
+
+            if( __atomic_load_n( &m_io_error, __ATOMIC_ACQUIRE ) )
+            {
+                /* Nothing more goes out until wait_idle() has seen the
+                   error; then what is still queued is counted as unacked
+                   and dropped */
+                if( __atomic_load_n( &m_io_reset, __ATOMIC_ACQUIRE ) || !run )
+                {
+                    uint64_t lost = 0;
+                    while( m_io_ring->pop( done ) )
+                    {
+                        lost++;
+                    }
+                    __atomic_fetch_add( &m_unacked, lost, __ATOMIC_RELAXED );
+                    __atomic_store_n( &m_io_reset, false, __ATOMIC_RELAXED );
+                    __atomic_store_n( &m_io_error, false, __ATOMIC_RELEASE );
+                }
+                if( !run )
+                {
+                    break;
+                }
+                usleep( IO_IDLE_USECS );
+                continue;
+            }
+
+            io_frame * f = m_io_ring->peek();
+            std::size_t n = 0;
+            bool ok = true;
+
+            if( f == NULL )
+            {
+                if( m_pending_count > 0 )
+                {
+                    ok = reap_ack();
+                }
+                else if( !run )
+                {
+                    break;
+                }
+                else
+                {
+                    usleep( IO_IDLE_USECS );
+                }
+            }
+            else
+            {
+                //Gather whatever else is already queued behind it
+                n = coalesce( m_io_ring->count() );
+                if( n == 1 )
+                {
+                    uint64_t unacked = __atomic_load_n( &m_unacked, __ATOMIC_RELAXED );
+
+                    ok = write_frame( f->frame, f->type );
+                    //Unless it was sent and already counted, it stays queued
+                    if( !ok && ( m_window > 1 || __atomic_load_n( &m_unacked, __ATOMIC_RELAXED ) == unacked ) )
+                    {
+                        n = 0;
+                    }
+                }
+                else
+                {
+                    for( std::size_t i = 0; i < n; ++i )
+                    {
+                        io_frame * next = m_io_ring->peek( i );
+                        chunks[i].data = (const uint8_t*)&next->frame;
+                        chunks[i].size = sizeof( next->frame );
+                        types[i]       = next->type;
+                    }
+                    ok = write_frames( chunks, types, n );
+                    if( !ok )
+                    {
+                        n = 0;
+                    }
+                }
+            }
+            __atomic_store_n( &m_io_pending, m_pending_count, __ATOMIC_RELEASE );
+            for( std::size_t i = 0; i < n; ++i )
+            {
+                m_io_ring->pop( done );
+            }
+            if( !ok )
+            {
+                __atomic_store_n( &m_io_error, true, __ATOMIC_RELEASE );
+            }
+        }
+    }
+
+    bool C::queue_frame( const lmc_command &l, stat_type type )
+    {
+        io_frame f;
+
+        f.frame = l;
+        f.type  = type;
+        while( true )
+        {
+            if( __atomic_load_n( &m_io_error, __ATOMIC_ACQUIRE ) )
+            {
+                return false;
+            }
+            if( m_io_ring->push( f ) )
+            {
+                return true;
+            }
+            usleep( IO_IDLE_USECS );
+        }
+    }
+
+    void C::set_window( int window )
+    {
+        if( window < 1 )
+        {
+            window = 1;
+        }
+        else if( window > MAX_WINDOW )
+        {
+            window = MAX_WINDOW;
+        }
+        m_window = window;
+    }
+
+    void C::set_max_coalesce( int frames )
+    {
+        if( frames < 1 )
+        {
+            frames = 1;
+        }
+        else if( frames > MAX_WINDOW )
+        {
+            frames = MAX_WINDOW;
+        }
+        m_max_coalesce = frames;
+    }
+
+    /*
+     * Find how many commands the firmware will buffer by sending ever
+     * larger bursts of moves to the current position, which are harmless
+     * if dropped, and keeping the largest burst that is fully acked.
+     */
+    int C::probe_window( int max_window )
+    {
+        int old_timeout = m_ack_timeout;
         lmc_command l;
+        int good = 1;
 
-        l.bytes  =13;
-        l.cmd    = 0x40;
-        l.data[0]=htocl( get_rand() );
-        l.data[1]=htocl( ptbuffer.y );
-        l.data[2]=htocl( ptbuffer.x );
-        btea(l.data, 3, k );
+        //Its probes would race the I/O thread for the port
+        if( m_io_ring != NULL || !wait_idle() )
+        {
+            return 0;
+        }
+        //A window the device cannot take loses acks; don't wait long for them
+        m_ack_timeout = CALIBRATE_ACK_TIMEOUT;
 
-        bool ret = false;
-        if( m_serial.p_write( (uint8_t*)&l, sizeof( l ) ) == sizeof( l ) )
+        encode( m_position, m_move_key, l, STAT_MOVE );
+        for( int n = 2; n <= max_window && n <= MAX_WINDOW; ++n )
         {
-            int num_chars = m_serial.p_read( rbuf, sizeof( rbuf ) );
-            if ( 5 != num_chars )
+            int acked = 0;
+            int sent;
+
+            for( sent = 0; sent < n; ++sent )
+            {
+                if( !transmit( (const uint8_t*)&l, sizeof( l ), STAT_MOVE ) )
+                {
+                    break;
+                }
+            }
+            while( acked < sent && wait_ack() )
             {
-                std::cout << "expected 5, got " << num_chars << std::endl;
-                assert( false );
+                acked++;
             }
-            ret = true;
+            if( acked < n )
+            {
+                m_port->flush_input();
+                break;
+            }
+            good = n;
+        }
+        m_ack_timeout = old_timeout;
+        set_window( good );
+        return good;
+    }
+
+    int C::calibrate_link_rate( const int * rates, int count, int trials, link_trial * results )
+    {
+        int  old_rate    = m_serial.get_link_rate();
+        int  old_timeout = m_ack_timeout;
+        int  old_retries = m_ack_retries;
+        bool old_stats   = stats_on();
+        int  best        = 0;
+
+        if( m_port != &m_serial || m_io_ring != NULL || !wait_idle() )
+        {
+            return 0;
+        }
+        m_ack_timeout   = CALIBRATE_ACK_TIMEOUT;
+        m_ack_retries   = 0;
+        __atomic_store_n( &m_stats_enabled, true, __ATOMIC_RELAXED );
+
+        for( int i = 0; i < count; ++i )
+        {
+            link_trial t;
+            lmc_command l;
+
+            t.rate  = rates[i];
+            t.sent  = 0;
+            m_serial.set_link_rate( rates[i] );
+            m_port->flush_input();
+            reset_stats();
+
+            encode( m_position, m_move_key, l, STAT_MOVE );
+            if( start() )
+            {
+                for( ; t.sent < trials; ++t.sent )
+                {
+                    write_frame( l, STAT_MOVE );
+                }
+                wait_idle();
+                m_port->delay( DELAY );
+                transmit( cmd_stop, sizeof( cmd_stop ), STAT_STOP );
+            }
+
+            const latency_histogram & ack = m_stats[ STAT_MOVE ].ack;
+            t.acked    = ack.count;
+            t.rtt_mean = ack.mean() / 1000.0;
+            t.rtt_p99  = ack.percentile( 99 ) / 1000.0;
+            if( t.sent > 0 && t.acked == t.sent && t.rate > best )
+            {
+                best = t.rate;
+            }
+            if( results != NULL )
+            {
+                results[i] = t;
+            }
+        }
+
+        m_serial.set_link_rate( best > 0 ? best : old_rate );
+        m_port->flush_input();
+        m_ack_timeout   = old_timeout;
+        m_ack_retries   = old_retries;
+        __atomic_store_n( &m_stats_enabled, old_stats, __ATOMIC_RELAXED );
+        reset_stats();
+        return best;
+    }
+
+    void C::reset_stats()
+    {
+        //The I/O thread writes these; let it go quiet first
+        io_settle();
+        for( int i = 0; i < NUM_STAT_TYPES; ++i )
+        {
+            m_stats[i].reset();
+        }
+        m_serial.reset_pacing_stats();
+        __atomic_store_n( &m_unacked, 0, __ATOMIC_RELAXED );
+    }
+
+    void C::dump_stats( std::ostream & out ) const
+    {
+        const pacing_stats & pacing = m_serial.get_pacing_stats();
+        char line[256];
+
+        print_stats( out, m_stats );
+        if( pacing.paced > 0 )
+        {
+            snprintf( line, sizeof( line ), "pacing: %llu waits, %llu late, lateness avg %.1f p99 %.1f max %.1f us\n",
+                (unsigned long long)pacing.paced,
+                (unsigned long long)pacing.late,
+                pacing.lateness.mean() / 1000.0,
+                pacing.lateness.percentile( 99 ) / 1000.0,
+                pacing.lateness.max / 1000.0 );
+            out << line;
         }
-        return ret;
     }
 
     xy C::get_dimensions()
@@ -154,27 +1279,3 @@ namespace Device
     }
 }
 
-
-/******************************************
-Host endianness TO device C endianness Long
-
-Device C talks little endian, so
-iff LE, return LE
-iff BE, return LE
-else assert
-******************************************/
-static inline uint32_t htocl( const uint32_t input )
-{
-#if defined(  _BIG_ENDIAN )
-return ( ( input & 0x000000FF ) << 24 ) |
-       ( ( input & 0x0000FF00 ) << 8  ) |
-       ( ( input & 0x00FF0000 ) >> 8  ) |
-       ( ( input & 0xFF000000 ) >> 24 ) ;
-#elif defined( _MIDDLE_ENDIAN ) || defined( _PDP_ENDIAN )
-return ( ( input & 0x0000FFFF ) << 16 ) |
-       ( ( input & 0xFFFF0000 ) >> 16 ) ;
-#else
-//Assume little endian
-return input;
-#endif
-}
@@ -0,0 +1,341 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "device_filter.hpp"
+
+namespace Device
+{
+    static inline bool same( const ixy &a, const ixy &b )
+    {
+        return a.x == b.x && a.y == b.y;
+    }
+
+    Filter::Filter( Generic & device, int units_per_inch )
+        : m_device( device ),
+        m_units( units_per_inch ),
+        m_position( 0, 0 ),
+        m_position_known( false ),
+        m_pending( 0, 0 ),
+        m_have_pending( false )
+    {
+        reset_stats();
+    }
+
+    void Filter::init( std::string aSerial )
+    {
+        m_device.init( aSerial );
+    }
+
+    const std::string Filter::device_name()
+    {
+        return m_device.device_name();
+    }
+
+    xy Filter::get_dimensions()
+    {
+        return m_device.get_dimensions();
+    }
+
+    bool Filter::start()
+    {
+        reset_stats();
+        m_position_known = false;
+        m_have_pending   = false;
+        return m_device.start();
+    }
+
+    bool Filter::stop()
+    {
+        bool ok = flush();
+
+        return m_device.stop() && ok;
+    }
+
+    bool Filter::move_to( const xy &aPoint )
+    {
+        command cmd;
+
+        cmd.type  = CMD_MOVE;
+        cmd.pt[0] = aPoint;
+        return forward( cmd );
+    }
+
+    bool Filter::cut_to( const xy &aPoint )
+    {
+        command cmd;
+
+        cmd.type  = CMD_CUT;
+        cmd.pt[0] = aPoint;
+        return forward( cmd );
+    }
+
+    bool Filter::curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 )
+    {
+        command cmd;
+
+        cmd.type  = CMD_CURVE;
+        cmd.pt[0] = p0;
+        cmd.pt[1] = p1;
+        cmd.pt[2] = p2;
+        cmd.pt[3] = p3;
+        return forward( cmd );
+    }
+
+    bool Filter::flush()
+    {
+        unit_command out[2];
+        std::size_t count = 0;
+
+        take_pending( out, count );
+        if( send( out, count ) < count )
+        {
+            m_position_known = false;
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t Filter::submit( const command * cmds, std::size_t count )
+    {
+        std::vector<unit_command> units( count );
+
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            units[i] = quantise( cmds[i] );
+        }
+        return count > 0 ? submit_units( &units[0], count ) : 0;
+    }
+
+    /* Filter a whole toolpath, then hand what is left on in one piece */
+    std::size_t Filter::submit_units( const unit_command * cmds, std::size_t count )
+    {
+        std::vector<unit_command> out;
+        std::vector<std::size_t> source;
+        std::size_t i;
+
+        out.reserve( count );
+        source.reserve( count );
+        for( i = 0; i < count; ++i )
+        {
+            unit_command buf[2];
+            std::size_t n;
+
+            if( !filter( cmds[i], buf, n ) )
+            {
+                break;
+            }
+            for( std::size_t j = 0; j < n; ++j )
+            {
+                out.push_back( buf[j] );
+                source.push_back( i );
+            }
+        }
+        count = i;
+
+        std::size_t done = out.empty() ? 0 : send( &out[0], out.size() );
+        if( done < out.size() )
+        {
+            m_position_known = false;
+            m_have_pending   = false;
+            return source[ done ];
+        }
+        return count;
+    }
+
+    void Filter::reset_stats()
+    {
+        memset( &m_stats, 0x00, sizeof( m_stats ) );
+    }
+
+    void Filter::dump_stats( std::ostream & out ) const
+    {
+        char line[ 256 ];
+
+        snprintf( line, sizeof( line ),
+            "filter: %llu commands in, %llu sent, %llu dropped "
+            "(%llu merged moves, %llu moves in place, %llu empty cuts, %llu empty curves)",
+            (unsigned long long)m_stats.commands, (unsigned long long)m_stats.sent,
+            (unsigned long long)m_stats.dropped(),
+            (unsigned long long)m_stats.moves_merged, (unsigned long long)m_stats.moves_in_place,
+            (unsigned long long)m_stats.empty_cuts, (unsigned long long)m_stats.empty_curves );
+        out << line << std::endl;
+    }
+
+    unit_command Filter::quantise( const command & cmd ) const
+    {
+        unit_command u;
+
+        u.type  = cmd.type;
+        u.pt[0] = to_units( cmd.pt[0], m_units );
+        if( cmd.type == CMD_CURVE )
+        {
+            u.pt[1] = to_units( cmd.pt[1], m_units );
+            u.pt[2] = to_units( cmd.pt[2], m_units );
+            u.pt[3] = to_units( cmd.pt[3], m_units );
+        }
+        return u;
+    }
+
+    bool Filter::forward( const command & cmd )
+    {
+        unit_command out[2];
+        std::size_t count;
+
+        if( !filter( quantise( cmd ), out, count ) )
+        {
+            return false;
+        }
+        if( send( out, count ) < count )
+        {
+            m_position_known = false;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Pass commands on in device units when the device works on the same
+     * grid, so a snapped point is never turned back into inches; anything
+     * else gets the snapped points in inches.
+     */
+    std::size_t Filter::send( const unit_command * cmds, std::size_t count )
+    {
+        if( count == 0 )
+        {
+            return 0;
+        }
+        if( m_device.get_units_per_inch() == m_units )
+        {
+            return m_device.submit_units( cmds, count );
+        }
+
+        std::vector<command> out( count );
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            int points = cmds[i].type == CMD_CURVE ? 4 : 1;
+
+            out[i].type = cmds[i].type;
+            for( int j = 0; j < points; ++j )
+            {
+                out[i].pt[j] = from_units( cmds[i].pt[j], m_units );
+            }
+        }
+        return m_device.submit( &out[0], count );
+    }
+
+    /* Turn the held move into a command, unless the head is already there */
+    bool Filter::take_pending( unit_command out[2], std::size_t & count )
+    {
+        if( !m_have_pending )
+        {
+            return false;
+        }
+        m_have_pending = false;
+        if( m_position_known && same( m_pending, m_position ) )
+        {
+            m_stats.moves_in_place++;
+            return false;
+        }
+        out[ count ].type  = CMD_MOVE;
+        out[ count ].pt[0] = m_pending;
+        count++;
+        m_stats.sent++;
+        m_position       = m_pending;
+        m_position_known = true;
+        return true;
+    }
+
+    /*
+     * Work out what one incoming command turns into: nothing, itself, or
+     * the held move followed by itself. The head position is updated as
+     * though everything returned gets sent.
+     */
+    bool Filter::filter( const unit_command & in, unit_command out[2], std::size_t & count )
+    {
+        const ixy * pt = in.pt;
+        int points;
+
+        count = 0;
+        switch( in.type )
+        {
+            case CMD_MOVE:
+            case CMD_CUT:
+                points = 1;
+                break;
+
+            case CMD_CURVE:
+                points = 4;
+                break;
+
+            default:
+                return false;
+        }
+        m_stats.commands++;
+
+        if( in.type == CMD_MOVE )
+        {
+            if( m_have_pending )
+            {
+                m_stats.moves_merged++;
+            }
+            m_pending      = pt[0];
+            m_have_pending = true;
+            return true;
+        }
+
+        take_pending( out, count );
+
+        bool empty = m_position_known;
+        for( int i = 0; i < points && empty; ++i )
+        {
+            empty = same( pt[i], m_position );
+        }
+        if( empty )
+        {
+            if( in.type == CMD_CUT )
+            {
+                m_stats.empty_cuts++;
+            }
+            else
+            {
+                m_stats.empty_curves++;
+            }
+            return true;
+        }
+
+        out[ count ].type = in.type;
+        for( int i = 0; i < points; ++i )
+        {
+            out[ count ].pt[i] = pt[i];
+        }
+        count++;
+        m_stats.sent++;
+        m_position       = pt[ points - 1 ];
+        m_position_known = true;
+        return true;
+    }
+}
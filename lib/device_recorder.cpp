@@ -0,0 +1,91 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "device_recorder.hpp"
+
+namespace Device
+{
+    Recorder::Recorder( const xy & dimensions )
+        : m_dimensions( dimensions )
+    {
+    }
+
+    const std::string Recorder::device_name()
+    {
+        return "Recorder";
+    }
+
+    xy Recorder::get_dimensions()
+    {
+        return m_dimensions;
+    }
+
+    bool Recorder::start()
+    {
+        return true;
+    }
+
+    bool Recorder::stop()
+    {
+        return true;
+    }
+
+    bool Recorder::move_to( const xy &aPoint )
+    {
+        command cmd;
+
+        cmd.type  = CMD_MOVE;
+        cmd.pt[0] = aPoint;
+        m_commands.push_back( cmd );
+        return true;
+    }
+
+    bool Recorder::cut_to( const xy &aPoint )
+    {
+        command cmd;
+
+        cmd.type  = CMD_CUT;
+        cmd.pt[0] = aPoint;
+        m_commands.push_back( cmd );
+        return true;
+    }
+
+    bool Recorder::curve_to( const xy &p0, const xy &p1, const xy &p2, const xy &p3 )
+    {
+        command cmd;
+
+        cmd.type  = CMD_CURVE;
+        cmd.pt[0] = p0;
+        cmd.pt[1] = p1;
+        cmd.pt[2] = p2;
+        cmd.pt[3] = p3;
+        m_commands.push_back( cmd );
+        return true;
+    }
+
+    void Recorder::clear()
+    {
+        m_commands.clear();
+    }
+}
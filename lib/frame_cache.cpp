@@ -0,0 +1,146 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include <cstdio>
+#include "frame_cache.hpp"
+
+void print_cache_stats( std::ostream & out, const char * name, const cache_stats & stats )
+{
+    char line[ 256 ];
+    char disk[ 32 ] = "";
+    uint64_t lookups = stats.lookups();
+
+    if( stats.disk_hits > 0 )
+    {
+        snprintf( disk, sizeof( disk ), " (%llu from disk)", (unsigned long long)stats.disk_hits );
+    }
+    snprintf( line, sizeof( line ),
+        "%s: %llu lookups, %llu hits%s, %llu misses, %llu evictions, %.1f%% hit",
+        name, (unsigned long long)lookups,
+        (unsigned long long)( stats.hits + stats.disk_hits ), disk,
+        (unsigned long long)stats.misses, (unsigned long long)stats.evictions,
+        lookups > 0 ? 100.0 * ( stats.hits + stats.disk_hits ) / lookups : 0.0 );
+    out << line << std::endl;
+}
+
+uint64_t fnv1a( const void * data, std::size_t size, uint64_t hash )
+{
+    const uint8_t * p = (const uint8_t *)data;
+
+    for( std::size_t i = 0; i < size; ++i )
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+frame_cache::frame_cache( std::size_t slots )
+    : m_slots( NULL ),
+    m_mask( 0 )
+{
+    reset_stats();
+    resize( slots );
+}
+
+frame_cache::~frame_cache()
+{
+    delete [] m_slots;
+}
+
+void frame_cache::resize( std::size_t slots )
+{
+    delete [] m_slots;
+    m_slots = NULL;
+    m_mask  = 0;
+    if( slots == 0 )
+    {
+        return;
+    }
+
+    std::size_t size = 1;
+    while( size < slots )
+    {
+        size <<= 1;
+    }
+    m_slots = new slot[ size ];
+    m_mask  = size - 1;
+    clear();
+}
+
+void frame_cache::clear()
+{
+    if( m_slots == NULL )
+    {
+        return;
+    }
+    for( std::size_t i = 0; i <= m_mask; ++i )
+    {
+        m_slots[i].type = -1;
+    }
+}
+
+bool frame_cache::lookup( stat_type type, const ixy & pt, lmc_command & l )
+{
+    if( m_slots == NULL )
+    {
+        return false;
+    }
+
+    const slot & s = m_slots[ index( type, pt ) ];
+    if( s.type == type && s.x == pt.x && s.y == pt.y )
+    {
+        l = s.frame;
+        m_stats.hits++;
+        return true;
+    }
+    m_stats.misses++;
+    return false;
+}
+
+void frame_cache::insert( stat_type type, const ixy & pt, const lmc_command & l )
+{
+    if( m_slots == NULL )
+    {
+        return;
+    }
+
+    slot & s = m_slots[ index( type, pt ) ];
+    if( s.type >= 0 )
+    {
+        m_stats.evictions++;
+    }
+    s.x     = pt.x;
+    s.y     = pt.y;
+    s.type  = type;
+    s.frame = l;
+}
+
+void frame_cache::reset_stats()
+{
+    m_stats.hits      = 0;
+    m_stats.disk_hits = 0;
+    m_stats.misses    = 0;
+    m_stats.evictions = 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "job_cache.hpp"
+#include "file_util.hpp"
+
+#define JOB_MAGIC   "CJOB"
+#define JOB_VERSION 1
+/* magic, version, hash, command count, frame count */
+#define JOB_HEADER  24
+/* end, x, y */
+#define JOB_COMMAND 12
+
+namespace Device
+{
+    job_cache::job_cache( std::size_t max_jobs, const std::string & dir )
+        : m_max_jobs( max_jobs > 0 ? max_jobs : 1 ),
+        m_dir( dir ),
+        m_clock( 0 )
+    {
+        reset_stats();
+    }
+
+    uint64_t job_cache::hash( const unit_command * cmds, std::size_t count, uint64_t key_id )
+    {
+        uint64_t h = fnv1a( &key_id, sizeof( key_id ) );
+
+        //Field by field: unused points of moves and cuts are garbage
+        for( std::size_t i = 0; i < count; ++i )
+        {
+            int32_t type = cmds[i].type;
+            int points = cmds[i].type == CMD_CURVE ? 4 : 1;
+
+            h = fnv1a( &type, sizeof( type ), h );
+            for( int j = 0; j < points; ++j )
+            {
+                h = fnv1a( &cmds[i].pt[j].x, sizeof( int32_t ), h );
+                h = fnv1a( &cmds[i].pt[j].y, sizeof( int32_t ), h );
+            }
+        }
+        return h;
+    }
+
+    std::string job_cache::file_for( uint64_t hash ) const
+    {
+        char name[ 32 ];
+
+        snprintf( name, sizeof( name ), "/%016llx.job", (unsigned long long)hash );
+        return m_dir + name;
+    }
+
+    const C::encoded_job * job_cache::find( uint64_t hash )
+    {
+        std::map<uint64_t, entry>::iterator it = m_jobs.find( hash );
+
+        if( it != m_jobs.end() )
+        {
+            it->second.used = ++m_clock;
+            m_stats.hits++;
+            return &it->second.job;
+        }
+
+        C::encoded_job job;
+        uint64_t stored;
+        if( !m_dir.empty() && load_job( file_for( hash ), job, stored ) && stored == hash )
+        {
+            entry & e = insert( hash );
+            e.job.frames.swap( job.frames );
+            e.job.types.swap( job.types );
+            e.job.ends.swap( job.ends );
+            e.job.positions.swap( job.positions );
+            m_stats.disk_hits++;
+            return &e.job;
+        }
+        m_stats.misses++;
+        return NULL;
+    }
+
+    const C::encoded_job * job_cache::store( uint64_t hash, C::encoded_job & job )
+    {
+        entry & e = insert( hash );
+
+        e.job.frames.swap( job.frames );
+        e.job.types.swap( job.types );
+        e.job.ends.swap( job.ends );
+        e.job.positions.swap( job.positions );
+        job = C::encoded_job();
+        if( !m_dir.empty() && !save_job( file_for( hash ), e.job, hash ) )
+        {
+            perror( file_for( hash ).c_str() );
+        }
+        return &e.job;
+    }
+
+    const C::encoded_job * job_cache::get( C & device, const unit_command * cmds, std::size_t count )
+    {
+        uint64_t h = hash( cmds, count, device.key_id() );
+        const C::encoded_job * cached = find( h );
+
+        if( cached != NULL )
+        {
+            return cached;
+        }
+
+        //Only a whole job may be found again under this hash
+        C::encoded_job job;
+        if( device.encode_job( cmds, count, job ) != count )
+        {
+            return NULL;
+        }
+        return store( h, job );
+    }
+
+    job_cache::entry & job_cache::insert( uint64_t hash )
+    {
+        std::map<uint64_t, entry>::iterator it = m_jobs.find( hash );
+
+        if( it == m_jobs.end() )
+        {
+            if( m_jobs.size() >= m_max_jobs )
+            {
+                std::map<uint64_t, entry>::iterator oldest = m_jobs.begin();
+                for( it = m_jobs.begin(); it != m_jobs.end(); ++it )
+                {
+                    if( it->second.used < oldest->second.used )
+                    {
+                        oldest = it;
+                    }
+                }
+                m_jobs.erase( oldest );
+                m_stats.evictions++;
+            }
+            it = m_jobs.insert( std::make_pair( hash, entry() ) ).first;
+        }
+        it->second.used = ++m_clock;
+        return it->second;
+    }
+
+    void job_cache::clear()
+    {
+        m_jobs.clear();
+    }
+
+    void job_cache::reset_stats()
+    {
+        m_stats.hits      = 0;
+        m_stats.disk_hits = 0;
+        m_stats.misses    = 0;
+        m_stats.evictions = 0;
+    }
+
+    void job_cache::dump_stats( std::ostream & out ) const
+    {
+        print_cache_stats( out, "job cache", m_stats );
+    }
+
+    bool save_job( const std::string & file, const C::encoded_job & job, uint64_t hash )
+    {
+        std::size_t commands = job.ends.size();
+        std::size_t frames   = job.frames.size();
+        std::vector<uint8_t> buf( JOB_HEADER + commands * JOB_COMMAND + frames * ( 1 + sizeof( lmc_command ) ) );
+        uint8_t * p = &buf[0];
+
+        memcpy( p, JOB_MAGIC, 4 );
+        put_le( p + 4,  JOB_VERSION );
+        put_le64( p + 8, hash );
+        put_le( p + 16, commands );
+        put_le( p + 20, frames );
+        p += JOB_HEADER;
+        for( std::size_t i = 0; i < commands; ++i, p += JOB_COMMAND )
+        {
+            put_le( p,     job.ends[i] );
+            put_le( p + 4, (uint32_t)job.positions[i].x );
+            put_le( p + 8, (uint32_t)job.positions[i].y );
+        }
+        for( std::size_t i = 0; i < frames; ++i )
+        {
+            *p++ = job.types[i];
+        }
+        if( frames > 0 )
+        {
+            memcpy( p, &job.frames[0], frames * sizeof( lmc_command ) );
+        }
+        return replace_file( file, &buf[0], buf.size() );
+    }
+
+    bool load_job( const std::string & file, C::encoded_job & job, uint64_t & hash )
+    {
+        FILE * in = fopen( file.c_str(), "rb" );
+        uint8_t header[ JOB_HEADER ];
+
+        if( in == NULL )
+        {
+            return false;
+        }
+        if( fread( header, 1, JOB_HEADER, in ) != JOB_HEADER ||
+            memcmp( header, JOB_MAGIC, 4 ) != 0 || get_le( header + 4 ) != JOB_VERSION )
+        {
+            fclose( in );
+            return false;
+        }
+        hash = get_le64( header + 8 );
+
+        std::size_t commands = get_le( header + 16 );
+        std::size_t frames   = get_le( header + 20 );
+        std::size_t size     = commands * JOB_COMMAND + frames * ( 1 + sizeof( lmc_command ) );
+
+        //Check the size before trusting the counts with an allocation
+        long here = ftell( in );
+        fseek( in, 0, SEEK_END );
+        if( ftell( in ) - here != (long)size )
+        {
+            fclose( in );
+            return false;
+        }
+        fseek( in, here, SEEK_SET );
+
+        std::vector<uint8_t> buf( size + 1 );
+        bool ok = fread( &buf[0], 1, size, in ) == size;
+        fclose( in );
+        if( !ok )
+        {
+            return false;
+        }
+
+        const uint8_t * p = &buf[0];
+        std::size_t last = 0;
+        job.ends.resize( commands );
+        job.positions.resize( commands );
+        for( std::size_t i = 0; i < commands; ++i, p += JOB_COMMAND )
+        {
+            job.ends[i] = get_le( p );
+            job.positions[i] = ixy( get_le( p + 4 ), get_le( p + 8 ) );
+            if( job.ends[i] <= last || job.ends[i] > frames )
+            {
+                return false;
+            }
+            last = job.ends[i];
+        }
+        if( last != frames )
+        {
+            return false;
+        }
+        job.types.resize( frames );
+        for( std::size_t i = 0; i < frames; ++i )
+        {
+            if( *p > STAT_CURVE )
+            {
+                return false;
+            }
+            job.types[i] = (stat_type)*p++;
+        }
+        job.frames.resize( frames );
+        if( frames > 0 )
+        {
+            memcpy( &job.frames[0], p, frames * sizeof( lmc_command ) );
+        }
+        return true;
+    }
+}
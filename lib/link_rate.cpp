@@ -0,0 +1,95 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "link_rate.hpp"
+#include "file_util.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+
+
+string link_rate_file()
+{
+    const char * file = getenv( "CUTTER_LINK_RATES" );
+    const char * home = getenv( "HOME" );
+
+    if( file != NULL )
+    {
+        return file;
+    }
+    if( home == NULL )
+    {
+        home = getenv( "USERPROFILE" );
+    }
+    return string( home != NULL ? home : "." ) + "/.cutter_link_rates";
+}
+
+
+bool load_link_rate( const string & device, int & rate )
+{
+    std::ifstream in( link_rate_file().c_str() );
+    string line;
+
+    while( std::getline( in, line ) )
+    {
+        std::istringstream fields( line );
+        string name;
+        int    value;
+
+        if( fields >> name >> value && name == device && value > 0 )
+        {
+            rate = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Rewrite the whole file, keeping every other device's line */
+bool save_link_rate( const string & device, int rate )
+{
+    string file = link_rate_file();
+    std::ostringstream out;
+    string line;
+
+    {
+        std::ifstream in( file.c_str() );
+        while( std::getline( in, line ) )
+        {
+            std::istringstream fields( line );
+            string name;
+            if( !( fields >> name ) || name != device )
+            {
+                out << line << "\n";
+            }
+        }
+    }
+    out << device << " " << rate << "\n";
+
+    string text = out.str();
+    return replace_file( file, text.data(), text.size() );
+}
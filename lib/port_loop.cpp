@@ -0,0 +1,479 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "port_loop.hpp"
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+using std::size_t;
+using std::deque;
+
+/* Same settle time Device::C leaves around start and stop */
+static const int     SETTLE_USECS = 170000;
+static const int     MAX_EVENTS   = 64;
+static const size_t  ACK_SIZE     = 5;
+
+static const uint8_t cmd_stop[] ={0x04, 0x22, 0x00, 0x00, 0x00 };
+static const uint8_t cmd_start[]={0x04, 0x21, 0x00, 0x00, 0x00 };
+
+/* epoll data: port id, and whether the event is for its timer */
+static inline uint64_t event_key( int id, bool timer )
+{
+    return ( (uint64_t)id << 1 ) | ( timer ? 1 : 0 );
+}
+
+
+port_loop::port_loop()
+{
+    epfd      = epoll_create( MAX_EVENTS );
+    completed = 0;
+    if( epfd < 0 )
+    {
+        perror( "port_loop: epoll_create" );
+    }
+}
+
+
+port_loop::~port_loop()
+{
+    for( size_t i = 0; i < ports.size(); ++i )
+    {
+        remove_port( i );
+    }
+    if( epfd >= 0 )
+    {
+        close( epfd );
+    }
+}
+
+
+int port_loop::add_port( serial_port * port, int window, int ack_timeout_ms )
+{
+    epoll_event ev;
+    port_state * p;
+    int id = ports.size();
+
+    if( epfd < 0 || port == NULL || !port->is_open() )
+    {
+        return -1;
+    }
+
+    p = new port_state;
+    p->port        = port;
+    p->fd          = port->get_fd();
+    p->timer       = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+    p->old_flags   = fcntl( p->fd, F_GETFL );
+    p->window      = window < 1 ? 1 : window;
+    p->ack_timeout = ack_timeout_ms;
+    p->written     = 0;
+    p->rx          = 0;
+    p->ready       = 0;
+    p->settled     = false;
+    p->want_out    = false;
+    p->out_armed   = false;
+    p->dead        = false;
+    p->timer_at    = 0;
+
+    if( p->timer < 0 )
+    {
+        perror( "port_loop: timerfd_create" );
+        delete p;
+        return -1;
+    }
+    fcntl( p->fd, F_SETFL, p->old_flags | O_NONBLOCK );
+
+    memset( &ev, 0x00, sizeof( ev ) );
+    ev.events   = EPOLLIN;
+    ev.data.u64 = event_key( id, false );
+    if( epoll_ctl( epfd, EPOLL_CTL_ADD, p->fd, &ev ) != 0 )
+    {
+        perror( "port_loop: epoll_ctl" );
+        fcntl( p->fd, F_SETFL, p->old_flags );
+        close( p->timer );
+        delete p;
+        return -1;
+    }
+    ev.data.u64 = event_key( id, true );
+    epoll_ctl( epfd, EPOLL_CTL_ADD, p->timer, &ev );
+
+    ports.push_back( p );
+    return id;
+}
+
+
+/* Whatever was still queued or in flight fails with READ_ERROR */
+void port_loop::remove_port( int id )
+{
+    if( id < 0 || id >= (int)ports.size() || ports[ id ] == NULL )
+    {
+        return;
+    }
+    port_state * p = ports[ id ];
+
+    ports[ id ] = NULL;
+    epoll_ctl( epfd, EPOLL_CTL_DEL, p->fd, NULL );
+    epoll_ctl( epfd, EPOLL_CTL_DEL, p->timer, NULL );
+    close( p->timer );
+    fcntl( p->fd, F_SETFL, p->old_flags );
+
+    fail( id, p->in_flight, transport::READ_ERROR );
+    fail( id, p->queue, transport::READ_ERROR );
+    delete p;
+}
+
+
+bool port_loop::queue_frame( int id, const lmc_command & l, completion_fn done, void * closure )
+{
+    return queue_entry( id, (const uint8_t *)&l, sizeof( l ), true, false, done, closure );
+}
+
+
+bool port_loop::queue_start( int id, completion_fn done, void * closure )
+{
+    return queue_entry( id, cmd_start, sizeof( cmd_start ), false, true, done, closure );
+}
+
+
+bool port_loop::queue_stop( int id, completion_fn done, void * closure )
+{
+    return queue_entry( id, cmd_stop, sizeof( cmd_stop ), false, true, done, closure );
+}
+
+
+bool port_loop::queue_entry( int id, const uint8_t * data, size_t size, bool acked, bool settle, completion_fn done, void * closure )
+{
+    entry e;
+
+    if( id < 0 || id >= (int)ports.size() || ports[ id ] == NULL || ports[ id ]->dead )
+    {
+        return false;
+    }
+    memcpy( e.data, data, size );
+    e.size     = size;
+    e.acked    = acked;
+    e.settle   = settle;
+    e.done     = done;
+    e.closure  = closure;
+    e.deadline = 0;
+    ports[ id ]->queue.push_back( e );
+    return true;
+}
+
+
+size_t port_loop::pending( int id ) const
+{
+    if( id < 0 || id >= (int)ports.size() || ports[ id ] == NULL )
+    {
+        return 0;
+    }
+    return ports[ id ]->queue.size() + ports[ id ]->in_flight.size();
+}
+
+
+bool port_loop::idle() const
+{
+    for( size_t i = 0; i < ports.size(); ++i )
+    {
+        if( pending( i ) > 0 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int port_loop::run_once( int timeout_ms )
+{
+    epoll_event events[ MAX_EVENTS ];
+    int n;
+
+    completed = 0;
+    for( size_t i = 0; i < ports.size(); ++i )
+    {
+        if( ports[i] != NULL )
+        {
+            service( i, *ports[i] );
+        }
+    }
+    if( completed > 0 )
+    {
+        timeout_ms = 0;
+    }
+
+    n = epoll_wait( epfd, events, MAX_EVENTS, timeout_ms );
+    for( int i = 0; i < n; ++i )
+    {
+        int  id    = events[i].data.u64 >> 1;
+        bool timer = events[i].data.u64 & 1;
+
+        if( id >= (int)ports.size() || ports[ id ] == NULL )
+        {
+            continue;
+        }
+        port_state & p = *ports[ id ];
+
+        if( timer )
+        {
+            uint64_t expirations;
+            if( read( p.timer, &expirations, sizeof( expirations ) ) > 0 )
+            {
+                p.timer_at = 0;
+            }
+        }
+        else
+        {
+            //Acks that came in before a hang up still count
+            if( events[i].events & EPOLLIN )
+            {
+                read_acks( id, p );
+            }
+            if( !p.dead && ( events[i].events & ( EPOLLERR | EPOLLHUP ) ) )
+            {
+                std::cout << "port " << id << ": hung up" << std::endl;
+                hang_up( id, p );
+            }
+        }
+    }
+
+    for( size_t i = 0; i < ports.size(); ++i )
+    {
+        if( ports[i] != NULL )
+        {
+            service( i, *ports[i] );
+        }
+    }
+    return completed;
+}
+
+
+void port_loop::run()
+{
+    while( !idle() )
+    {
+        run_once( -1 );
+    }
+}
+
+
+/*
+ * Expire the oldest ack if it is overdue, then write as many queued
+ * frames as pacing, the window and start/stop settling allow.
+ */
+void port_loop::service( int id, port_state & p )
+{
+    uint64_t now = p.port->getTime();
+
+    if( !p.in_flight.empty() && p.ack_timeout >= 0 && now >= p.in_flight.front().deadline )
+    {
+        /* Acks carry no sequence number, so everything in flight goes */
+        fail( id, p.in_flight, transport::READ_TIMEOUT );
+        p.port->flush_input();
+        p.rx = 0;
+    }
+
+    p.want_out = false;
+    while( !p.queue.empty() )
+    {
+        entry & e = p.queue.front();
+        ssize_t r;
+
+        if( p.written == 0 )
+        {
+            if( now < p.ready )
+            {
+                break;
+            }
+            if( e.settle && !p.in_flight.empty() )
+            {
+                break;
+            }
+            if( e.settle && !p.settled )
+            {
+                p.settled = true;
+                p.ready   = now + SETTLE_USECS;
+                continue;
+            }
+            if( e.acked && (int)p.in_flight.size() >= p.window )
+            {
+                break;
+            }
+        }
+
+        r = write( p.fd, e.data + p.written, e.size - p.written );
+        if( r < 0 )
+        {
+            if( errno == EAGAIN || errno == EINTR )
+            {
+                p.want_out = true;
+                break;
+            }
+            std::cout << "port " << id << ": write failed" << std::endl;
+            hang_up( id, p );
+            break;
+        }
+        p.written += r;
+        if( p.written < e.size )
+        {
+            p.want_out = true;
+            break;
+        }
+
+        p.port->record( CAPTURE_TX, e.data, e.size );
+        p.written = 0;
+        p.settled = false;
+        p.ready   = now + e.size * p.port->byte_time();
+
+        entry sent = e;
+        p.queue.pop_front();
+        if( sent.acked )
+        {
+            sent.deadline = now + (uint64_t)p.ack_timeout * 1000;
+            p.in_flight.push_back( sent );
+        }
+        else
+        {
+            complete( id, sent, transport::READ_OK );
+        }
+    }
+    arm( id, p, now );
+}
+
+
+void port_loop::read_acks( int id, port_state & p )
+{
+    uint8_t buf[ 64 ];
+    ssize_t r;
+    bool    got = false;
+
+    while( ( r = read( p.fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+        got = true;
+        p.port->record( CAPTURE_RX, buf, r );
+        p.rx += r;
+        while( p.rx >= ACK_SIZE && !p.in_flight.empty() )
+        {
+            entry e = p.in_flight.front();
+            p.in_flight.pop_front();
+            p.rx -= ACK_SIZE;
+            complete( id, e, transport::READ_OK );
+        }
+        if( p.in_flight.empty() )
+        {
+            /* nothing was waiting for these */
+            p.rx = 0;
+        }
+    }
+
+    /* With VMIN 0 an empty read after data only means the port is
+       drained; readable with nothing at all to read is end of file */
+    if( ( r == 0 && !got ) || ( r < 0 && errno != EAGAIN && errno != EINTR ) )
+    {
+        std::cout << "port " << id << ": read failed" << std::endl;
+        hang_up( id, p );
+    }
+}
+
+
+void port_loop::complete( int id, const entry & e, transport::read_status_t status )
+{
+    completed++;
+    if( e.done != NULL )
+    {
+        e.done( id, status, e.closure );
+    }
+}
+
+
+/* Completes a snapshot of q, so frames that callbacks queue again on
+   the same port wait for the next pass instead of failing forever */
+void port_loop::fail( int id, deque<entry> & q, transport::read_status_t status )
+{
+    deque<entry> failed;
+
+    failed.swap( q );
+    while( !failed.empty() )
+    {
+        entry e = failed.front();
+        failed.pop_front();
+        complete( id, e, status );
+    }
+}
+
+
+/* Stop polling a port whose link is gone, so a level-triggered hang up
+   cannot spin the loop, and fail everything on it */
+void port_loop::hang_up( int id, port_state & p )
+{
+    if( !p.dead )
+    {
+        p.dead = true;
+        epoll_ctl( epfd, EPOLL_CTL_DEL, p.fd, NULL );
+    }
+    p.written = 0;
+    fail( id, p.in_flight, transport::READ_ERROR );
+    fail( id, p.queue, transport::READ_ERROR );
+}
+
+
+/* Point the timer at the next pacing or ack deadline, and only ask for
+   EPOLLOUT while a frame is half written */
+void port_loop::arm( int id, port_state & p, uint64_t now )
+{
+    itimerspec  its;
+    epoll_event ev;
+    uint64_t    next = 0;
+
+    if( !p.queue.empty() && p.ready > now )
+    {
+        next = p.ready;
+    }
+    if( !p.in_flight.empty() && p.ack_timeout >= 0 && ( next == 0 || p.in_flight.front().deadline < next ) )
+    {
+        next = p.in_flight.front().deadline;
+    }
+
+    if( next != p.timer_at )
+    {
+        memset( &its, 0x00, sizeof( its ) );
+        its.it_value.tv_sec  = next / 1000000;
+        its.it_value.tv_nsec = ( next % 1000000 ) * 1000;
+        timerfd_settime( p.timer, TFD_TIMER_ABSTIME, &its, NULL );
+        p.timer_at = next;
+    }
+
+    if( !p.dead && p.want_out != p.out_armed )
+    {
+        memset( &ev, 0x00, sizeof( ev ) );
+        ev.events   = EPOLLIN | ( p.want_out ? EPOLLOUT : 0 );
+        ev.data.u64 = event_key( id, false );
+        epoll_ctl( epfd, EPOLL_CTL_MOD, p.fd, &ev );
+        p.out_armed = p.want_out;
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "realtime.hpp"
+#include <cstring>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#if( __linux )
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+/* Stack the I/O path may use, faulted in up front */
+static const std::size_t STACK_PREFAULT = 256 * 1024;
+static const std::size_t PAGE = 4096;
+
+
+void prefault( void * data, std::size_t size )
+{
+    volatile uint8_t * p = (volatile uint8_t *)data;
+
+    for( std::size_t i = 0; i < size; i += PAGE )
+    {
+        p[i] = p[i];
+    }
+}
+
+
+static void prefault_stack()
+{
+    uint8_t stack[ STACK_PREFAULT ];
+
+    memset( stack, 0x00, sizeof( stack ) );
+    prefault( stack, sizeof( stack ) );
+}
+
+
+bool enter_realtime( const realtime_config & config, realtime_report & report )
+{
+    memset( &report, 0x00, sizeof( report ) );
+
+    #if( __linux )
+    if( config.cpu >= 0 )
+    {
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( config.cpu, &set );
+        report.pin_error = pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+        report.pinned    = report.pin_error == 0;
+    }
+    if( config.lock_memory )
+    {
+        report.lock_error = mlockall( MCL_CURRENT | MCL_FUTURE ) == 0 ? 0 : errno;
+        report.locked     = report.lock_error == 0;
+        prefault_stack();
+    }
+    if( config.priority > 0 )
+    {
+        sched_param param;
+        memset( &param, 0x00, sizeof( param ) );
+        param.sched_priority = config.priority;
+        report.fifo_error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+        report.fifo       = report.fifo_error == 0;
+    }
+    #else
+    report.pin_error  = config.cpu >= 0      ? ENOSYS : 0;
+    report.fifo_error = config.priority > 0  ? ENOSYS : 0;
+    report.lock_error = config.lock_memory   ? ENOSYS : 0;
+    #endif
+
+    return report.pin_error == 0 && report.fifo_error == 0 && report.lock_error == 0;
+}
+
+
+void print_realtime_report( std::ostream & out, const realtime_config & config, const realtime_report & report )
+{
+    if( config.cpu >= 0 )
+    {
+        out << "realtime: pin to CPU " << config.cpu << ": "
+            << ( report.pinned ? "ok" : strerror( report.pin_error ) ) << std::endl;
+    }
+    if( config.priority > 0 )
+    {
+        out << "realtime: SCHED_FIFO priority " << config.priority << ": "
+            << ( report.fifo ? "ok" : strerror( report.fifo_error ) );
+        if( report.fifo_error == EPERM )
+        {
+            out << " (needs CAP_SYS_NICE or an rtprio limit in limits.conf)";
+        }
+        out << std::endl;
+    }
+    if( config.lock_memory )
+    {
+        out << "realtime: lock memory: "
+            << ( report.locked ? "ok" : strerror( report.lock_error ) );
+        if( report.lock_error == EPERM || report.lock_error == ENOMEM )
+        {
+            out << " (needs CAP_IPC_LOCK or a larger memlock limit)";
+        }
+        out << std::endl;
+    }
+}
@@ -23,28 +23,45 @@
  * 3101 Mercier Street #404, Kansas City, MO 64111
  */
 #include "serial_port.hpp"
+#include "link_rate.hpp"
 #include <cstdio>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <cstdlib>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include <cmath>
+#include <cerrno>
 #include <string>
 #if( __APPLE__ )
 #include <IOKit/serial/ioss.h>
 #endif
+#ifdef CUTTER_IO_URING
+#include "uring_io.hpp"
+#endif
 
 using std::size_t;
 
 #include <iostream>
 using namespace std;
 
+static const uint64_t GOAL_USECS       = (uint64_t)( TIMING_GOAL * 1000000 );
+static const uint64_t CONSTRAINT_USECS = (uint64_t)( TIMING_CONSTRAINT * 1000000 );
+
 serial_port::serial_port()
 {
-    fd = -1;
+    fd        = -1;
+    uring     = NULL;
+    tx_mode   = TX_FRAME;
+    byte_gap  = 0;
+    link_rate = LINK_RATE;
+    tx_ready  = 0;
+    reset_pacing_stats();
 }
 
 
@@ -60,13 +77,20 @@ bool serial_port::is_open()
 }
 
 
-serial_port::serial_port( const string & filename )
+serial_port::serial_port( const string & filename, int rate )
 {
-    p_open( filename );
+    fd        = -1;
+    uring     = NULL;
+    tx_mode   = TX_FRAME;
+    byte_gap  = 0;
+    link_rate = LINK_RATE;
+    tx_ready  = 0;
+    reset_pacing_stats();
+    p_open( filename, rate );
 }
 
 
-void serial_port::p_open( const string & filename )
+void serial_port::p_open( const string & filename, int rate )
 {
     termios newtio;
 
@@ -83,32 +107,43 @@ void serial_port::p_open( const string & filename )
 
         newtio.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG );
         newtio.c_oflag &= ~OPOST;
-        newtio.c_cc[VMIN]  = 5;
+        //Reads never block in the driver; p_read_timed() waits in poll()
+        newtio.c_cc[VMIN]  = 0;
         newtio.c_cc[VTIME] = 0;
-        //255;
 
         tcflush(fd, TCIFLUSH);
         tcsetattr(fd,TCSANOW,&newtio);
 
         #if( __linux )
-        //ASYNC_SPD_MASK
-        serial_struct sstruct;
         ioctl( fd, TIOCGSERIAL, &oldsstruct );
-        sstruct = oldsstruct;
-        sstruct.custom_divisor = sstruct.baud_base / 200000;
-        sstruct.flags &= ~ASYNC_SPD_MASK;
-        sstruct.flags |= ASYNC_SPD_MASK & ASYNC_SPD_CUST;
-        printf("Divisor=%i\n", sstruct.custom_divisor );
+        #endif
+        if( rate <= 0 && !load_link_rate( filename, rate ) )
+        {
+            rate = LINK_RATE;
+        }
+        set_link_rate( rate );
 
-        int r = ioctl( fd, TIOCSSERIAL, &sstruct );
-        printf("r=%i\n",r);
-        #elif( __APPLE__ )
-        speed_t baud_rate = 200000;
-        if( ioctl( fd, IOSSIOSPEED, &baud_rate ) == -1 )
+        #ifdef CUTTER_IO_URING
+        //io_uring reads have no poll() in front, so they must block
+        uring = new uring_io();
+        if( uring->setup( fd, getenv( "CUTTER_URING_SQPOLL" ) != NULL ) )
         {
-            std::cout << "driver may not support IOSSIOSPEED" << std::endl;
+            newtio.c_cc[VMIN] = 1;
+            tcsetattr( fd, TCSANOW, &newtio );
+        }
+        else
+        {
+            std::cout << "io_uring unavailable, using read() and write()" << std::endl;
+            delete uring;
+            uring = NULL;
         }
         #endif
+
+        const char * capture_file = getenv( "CUTTER_CAPTURE" );
+        if( capture_file != NULL )
+        {
+            start_capture( capture_file );
+        }
     }
 
     #ifdef SERIAL_PORT_DEBUG_MODE
@@ -125,6 +160,11 @@ void serial_port::p_open( const string & filename )
 
 void serial_port::p_close()
 {
+    stop_capture();
+    #ifdef CUTTER_IO_URING
+    delete uring;
+    uring = NULL;
+    #endif
     if( fd >= 0 )
     {
         tcsetattr( fd, TCSANOW, &oldtio );
@@ -139,12 +179,44 @@ void serial_port::p_close()
 
 
 size_t serial_port::p_write( const uint8_t * data, size_t size )
+{
+    size_t count;
+
+    if( tx_mode == TX_PER_BYTE )
+    {
+        count = write_per_byte( data, size );
+    }
+    else
+    {
+        count = write_frame( data, size );
+    }
+
+    if( capture.is_open() )
+    {
+        capture.record( CAPTURE_TX, data, count, getTime() );
+    }
+    return count;
+}
+
+
+/*
+ * Each byte is scheduled against an absolute deadline one gap after the
+ * previous one, so sleep overshoot on one byte is taken out of the next
+ * gap instead of accumulating. Spacing never drops below
+ * TIMING_GOAL - TIMING_CONSTRAINT; if we wake up later than that allows,
+ * the schedule restarts from now rather than bursting to catch up.
+ */
+size_t serial_port::write_per_byte( const uint8_t * data, size_t size )
 {
     size_t   i;
     int      count = 0;
+    uint64_t gap = byte_gap > 0 ? byte_gap : GOAL_USECS;
+    uint64_t now = getTime();
+    uint64_t deadline = tx_ready > now ? tx_ready : now;
+
     for( i = 0; i < size; ++i )
     {
-	delay(1000);
+        uint64_t lateness = pace_until( deadline );
 
         if( write( fd, data, 1 ) == 1 )
         {
@@ -156,29 +228,428 @@ size_t serial_port::p_write( const uint8_t * data, size_t size )
             break;
         }
 
+        if( lateness > CONSTRAINT_USECS )
+        {
+            deadline = getTime() + gap;
+        }
+        else
+        {
+            deadline += gap;
+        }
     }
+    tx_ready = deadline;
     return count;
 }
 
 
+/*
+ * Hand the whole frame to the kernel at once. The UART clocks the bytes
+ * out back to back, so the only pacing left to do is to not start the
+ * next frame before this one has left the wire.
+ */
+size_t serial_port::write_frame( const uint8_t * data, size_t size )
+{
+    size_t  count = 0;
+    ssize_t r;
+    uint64_t start = getTime();
+
+    if( start < tx_ready )
+    {
+        pace_until( tx_ready );
+        start = tx_ready;
+    }
+
+    #ifdef CUTTER_IO_URING
+    if( uring != NULL )
+    {
+        count = uring->write( data, size ) ? size : 0;
+        tx_ready = start + (uint64_t)count * byte_time();
+        return count;
+    }
+    #endif
+
+    while( count < size )
+    {
+        r = write( fd, data + count, size - count );
+        if( r < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            break;
+        }
+        count += r;
+    }
+
+    tx_ready = start + (uint64_t)count * byte_time();
+    return count;
+}
+
+
+/*
+ * In frame mode the whole batch goes to the kernel in one writev(), with
+ * the same pacing as a single frame: wait for the previous write to
+ * leave the wire, then let the UART clock everything out back to back.
+ */
+size_t serial_port::p_writev( const io_chunk * chunks, size_t count )
+{
+    static const size_t MAX_IOV = 64;
+    iovec    iov[ MAX_IOV ];
+    size_t   total = 0;
+    size_t   done  = 0;
+    size_t   n;
+    ssize_t  r;
+    uint64_t start;
+
+    if( tx_mode == TX_PER_BYTE || count <= 1 || count > MAX_IOV )
+    {
+        return transport::p_writev( chunks, count );
+    }
+
+    for( n = 0; n < count; ++n )
+    {
+        iov[n].iov_base = (void *)chunks[n].data;
+        iov[n].iov_len  = chunks[n].size;
+        total += chunks[n].size;
+    }
+
+    start = getTime();
+    if( start < tx_ready )
+    {
+        pace_until( tx_ready );
+        start = tx_ready;
+    }
+
+    #ifdef CUTTER_IO_URING
+    if( uring != NULL )
+    {
+        done = uring->write( chunks, count ) ? total : 0;
+    }
+    else
+    #endif
+    {
+        iovec * next = iov;
+        while( n > 0 )
+        {
+            r = writev( fd, next, n );
+            if( r < 0 )
+            {
+                if( errno == EINTR )
+                {
+                    continue;
+                }
+                break;
+            }
+            done += r;
+            while( n > 0 && (size_t)r >= next->iov_len )
+            {
+                r -= next->iov_len;
+                next++;
+                n--;
+            }
+            if( n > 0 )
+            {
+                next->iov_base = (uint8_t *)next->iov_base + r;
+                next->iov_len -= r;
+            }
+        }
+    }
+    tx_ready = start + (uint64_t)done * byte_time();
+
+    if( capture.is_open() )
+    {
+        size_t left = done;
+        for( size_t i = 0; i < count && left > 0; ++i )
+        {
+            size_t size = chunks[i].size < left ? chunks[i].size : left;
+            capture.record( CAPTURE_TX, chunks[i].data, size, getTime() );
+            left -= size;
+        }
+    }
+    return done;
+}
+
+
 size_t serial_port::p_read( uint8_t * data, size_t size )
 {
+    size_t count = 0;
+
+    p_read_timed( data, size, -1, count );
+    return count;
+}
+
+
+/*
+ * Wait up to timeout_ms (forever if negative) for size bytes, keeping
+ * whatever arrives in pieces. count always holds the bytes received.
+ */
+serial_port::read_status_t serial_port::p_read_timed( uint8_t * data, size_t size, int timeout_ms, size_t & count )
+{
+    read_status_t status = read_timed( data, size, timeout_ms, count );
+
+    if( capture.is_open() && count > 0 )
+    {
+        capture.record( CAPTURE_RX, data, count, getTime() );
+    }
+    return status;
+}
+
+
+serial_port::read_status_t serial_port::read_timed( uint8_t * data, size_t size, int timeout_ms, size_t & count )
+{
+    pollfd   pfd;
+    ssize_t  r;
+    int      wait_ms = -1;
+    uint64_t deadline = getTime() + (uint64_t)( timeout_ms > 0 ? timeout_ms : 0 ) * 1000;
+
+    count = 0;
     if( fd < 0 )
     {
         cout<<"Error reading from closed port"<<endl;
+        return READ_ERROR;
+    }
+    #ifdef CUTTER_IO_URING
+    if( uring != NULL )
+    {
+        return uring->read( data, size, timeout_ms >= 0 ? deadline : 0, count );
+    }
+    #endif
+
+    pfd.fd     = fd;
+    pfd.events = POLLIN;
+    while( count < size )
+    {
+        if( timeout_ms >= 0 )
+        {
+            uint64_t now = getTime();
+            wait_ms = now < deadline ? ( deadline - now + 999 ) / 1000 : 0;
+        }
+
+        r = poll( &pfd, 1, wait_ms );
+        if( r < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            return READ_ERROR;
+        }
+        if( r == 0 )
+        {
+            return READ_TIMEOUT;
+        }
+        if( !( pfd.revents & POLLIN ) )
+        {
+            return READ_ERROR;
+        }
+
+        r = read( fd, (void*)( data + count ), size - count );
+        if( r < 0 )
+        {
+            if( errno == EINTR || errno == EAGAIN )
+            {
+                continue;
+            }
+            return READ_ERROR;
+        }
+        if( r == 0 )
+        {
+            //Readable but nothing there: the other end hung up
+            return READ_ERROR;
+        }
+        count += r;
     }
-    return read( fd, (void*)data, size );
+    return READ_OK;
 }
 
 
-const uint64_t serial_port::getTime( void )
+/* Drop anything received but not yet read, e.g. the rest of a torn ack */
+void serial_port::flush_input()
 {
-    timeval tv;
-    gettimeofday( &tv, NULL );
-    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec ;
+    if( fd >= 0 )
+    {
+        tcflush( fd, TCIFLUSH );
+    }
+}
+
+
+/*
+ * Sleep until an absolute time on the getTime() clock and return how many
+ * usecs late we woke up.
+ */
+uint64_t serial_port::pace_until( uint64_t deadline )
+{
+    uint64_t now = getTime();
+    uint64_t lateness;
+
+    if( now < deadline )
+    {
+        #if( __linux )
+        timespec ts;
+        ts.tv_sec  = deadline / 1000000;
+        ts.tv_nsec = ( deadline % 1000000 ) * 1000;
+        while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR )
+        {
+        }
+        #else
+        usleep( deadline - now );
+        #endif
+        now = getTime();
+    }
+
+    lateness = now > deadline ? now - deadline : 0;
+    pacing.paced++;
+    pacing.total_lateness += lateness;
+    pacing.lateness.add( lateness * 1000 );
+    if( lateness > pacing.max_lateness )
+    {
+        pacing.max_lateness = lateness;
+    }
+    if( lateness > CONSTRAINT_USECS )
+    {
+        pacing.late++;
+    }
+    return lateness;
+}
+
+
+const pacing_stats & serial_port::get_pacing_stats() const
+{
+    return pacing;
+}
+
+
+void serial_port::reset_pacing_stats()
+{
+    memset( &pacing, 0x00, sizeof( pacing ) );
 }
 
 int serial_port::delay( int usecs )
 {
     return usleep(usecs);
 }
+
+
+bool serial_port::start_capture( const string & filename )
+{
+    return capture.open( filename, getTime() );
+}
+
+
+void serial_port::stop_capture()
+{
+    capture.close();
+}
+
+
+void serial_port::record( capture_dir dir, const uint8_t * data, size_t size )
+{
+    if( capture.is_open() && size > 0 )
+    {
+        capture.record( dir, data, size, getTime() );
+    }
+}
+
+
+int serial_port::get_fd() const
+{
+    return fd;
+}
+
+
+void serial_port::set_tx_mode( tx_mode_t mode )
+{
+    tx_mode = mode;
+}
+
+
+serial_port::tx_mode_t serial_port::get_tx_mode() const
+{
+    return tx_mode;
+}
+
+
+void serial_port::set_byte_gap( int usecs )
+{
+    byte_gap = usecs;
+}
+
+
+int serial_port::get_byte_gap() const
+{
+    return byte_gap;
+}
+
+
+/*
+ * The Linux driver runs at baud_base / custom_divisor whenever B38400 is
+ * selected with ASYNC_SPD_CUST, so the rate we end up with is the nearest
+ * one at or above the request that the divisor can express.
+ */
+bool serial_port::set_link_rate( int rate )
+{
+    bool ok = false;
+
+    if( rate <= 0 )
+    {
+        return false;
+    }
+    link_rate = rate;
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    #if( __linux )
+    //ASYNC_SPD_MASK
+    serial_struct sstruct;
+    if( ioctl( fd, TIOCGSERIAL, &sstruct ) == 0 && sstruct.baud_base > 0 )
+    {
+        sstruct.custom_divisor = sstruct.baud_base / rate;
+        if( sstruct.custom_divisor < 1 )
+        {
+            sstruct.custom_divisor = 1;
+        }
+        sstruct.flags &= ~ASYNC_SPD_MASK;
+        sstruct.flags |= ASYNC_SPD_MASK & ASYNC_SPD_CUST;
+        printf("Divisor=%i\n", sstruct.custom_divisor );
+
+        int r = ioctl( fd, TIOCSSERIAL, &sstruct );
+        printf("r=%i\n",r);
+        if( r == 0 )
+        {
+            link_rate = sstruct.baud_base / sstruct.custom_divisor;
+            ok = true;
+        }
+    }
+    #elif( __APPLE__ )
+    speed_t baud_rate = rate;
+    if( ioctl( fd, IOSSIOSPEED, &baud_rate ) == -1 )
+    {
+        std::cout << "driver may not support IOSSIOSPEED" << std::endl;
+    }
+    else
+    {
+        ok = true;
+    }
+    #endif
+    return ok;
+}
+
+
+int serial_port::get_link_rate() const
+{
+    return link_rate;
+}
+
+
+/* Microseconds one byte occupies the line, unless a gap was calibrated */
+int serial_port::byte_time() const
+{
+    if( byte_gap > 0 )
+    {
+        return byte_gap;
+    }
+    return ( BITS_PER_BYTE * 1000000 + link_rate - 1 ) / link_rate;
+}
@@ -23,6 +23,7 @@
  * 3101 Mercier Street #404, Kansas City, MO 64111
  */
 #include "serial_port.hpp"
+#include "link_rate.hpp"
 #include <cstdio>
 #include <sys/types.h>
 #include <cstdlib>
@@ -30,6 +31,7 @@
 #include <unistd.h>
 #include <cmath>
 #include <string>
+#include <vector>
 #include <windows.h>
 
 using std::size_t;
@@ -37,9 +39,17 @@ using std::size_t;
 #include <iostream>
 using namespace std;
 
+static const uint64_t GOAL_USECS       = (uint64_t)( TIMING_GOAL * 1000000 );
+static const uint64_t CONSTRAINT_USECS = (uint64_t)( TIMING_CONSTRAINT * 1000000 );
+
 serial_port::serial_port()
 {
-    fd = INVALID_HANDLE_VALUE;
+    fd        = INVALID_HANDLE_VALUE;
+    tx_mode   = TX_FRAME;
+    byte_gap  = 0;
+    link_rate = LINK_RATE;
+    tx_ready  = 0;
+    reset_pacing_stats();
 }
 
 
@@ -55,13 +65,19 @@ bool serial_port::is_open()
 }
 
 
-serial_port::serial_port( const string & filename )
+serial_port::serial_port( const string & filename, int rate )
 {
-    p_open( filename );
+    fd        = INVALID_HANDLE_VALUE;
+    tx_mode   = TX_FRAME;
+    byte_gap  = 0;
+    link_rate = LINK_RATE;
+    tx_ready  = 0;
+    reset_pacing_stats();
+    p_open( filename, rate );
 }
 
 
-void serial_port::p_open( const string & filename )
+void serial_port::p_open( const string & filename, int rate )
 {
     DCB newdcb = { 0 };
     COMMTIMEOUTS newtimeouts = { 0 };
@@ -74,7 +90,12 @@ void serial_port::p_open( const string & filename )
             // Could not save comm state
         }
         newdcb.DCBlength = sizeof( newdcb );
-        newdcb.BaudRate = 200000;
+        if( rate <= 0 && !load_link_rate( filename, rate ) )
+        {
+            rate = LINK_RATE;
+        }
+        newdcb.BaudRate = rate;
+        link_rate = rate;
         newdcb.ByteSize = 8;
         newdcb.StopBits = ONESTOPBIT;
         newdcb.Parity = NOPARITY;
@@ -92,12 +113,19 @@ void serial_port::p_open( const string & filename )
         {
             // Could not set timeouts
         }
+
+        const char * capture_file = getenv( "CUTTER_CAPTURE" );
+        if( capture_file != NULL )
+        {
+            start_capture( capture_file );
+        }
     }
 }
 
 
 void serial_port::p_close()
 {
+    stop_capture();
     if( fd != INVALID_HANDLE_VALUE )
     {
         CloseHandle( fd );
@@ -109,18 +137,42 @@ void serial_port::p_close()
 
 size_t serial_port::p_write( const uint8_t * data, size_t size )
 {
-    size_t   i;
-    int      count = 0;
-    DWORD    bytesWritten = 0;
+    size_t count;
 
     if( fd == INVALID_HANDLE_VALUE )
     {
         return 0;
     }
 
+    if( tx_mode == TX_PER_BYTE )
+    {
+        count = write_per_byte( data, size );
+    }
+    else
+    {
+        count = write_frame( data, size );
+    }
+
+    if( capture.is_open() )
+    {
+        capture.record( CAPTURE_TX, data, count, getTime() );
+    }
+    return count;
+}
+
+
+size_t serial_port::write_per_byte( const uint8_t * data, size_t size )
+{
+    size_t   i;
+    int      count = 0;
+    DWORD    bytesWritten = 0;
+    uint64_t gap = byte_gap > 0 ? byte_gap : GOAL_USECS;
+    uint64_t now = getTime();
+    uint64_t deadline = tx_ready > now ? tx_ready : now;
+
     for( i = 0; i < size; ++i )
     {
-	delay(1000);
+        uint64_t lateness = pace_until( deadline );
 
         if( WriteFile( fd, data, 1, &bytesWritten, NULL ) )
         {
@@ -132,34 +184,160 @@ size_t serial_port::p_write( const uint8_t * data, size_t size )
             break;
         }
 
+        if( lateness > CONSTRAINT_USECS )
+        {
+            deadline = getTime() + gap;
+        }
+        else
+        {
+            deadline += gap;
+        }
     }
+    tx_ready = deadline;
     return count;
 }
 
 
+size_t serial_port::write_frame( const uint8_t * data, size_t size )
+{
+    DWORD    bytesWritten = 0;
+    uint64_t start = getTime();
+
+    if( start < tx_ready )
+    {
+        pace_until( tx_ready );
+        start = tx_ready;
+    }
+
+    if( !WriteFile( fd, data, size, &bytesWritten, NULL ) )
+    {
+        return 0;
+    }
+
+    tx_ready = start + (uint64_t)bytesWritten * byte_time();
+    return bytesWritten;
+}
+
+
+/* No writev here: gather the batch and send it as one frame */
+size_t serial_port::p_writev( const io_chunk * chunks, size_t count )
+{
+    std::vector<uint8_t> batch;
+    size_t done;
+
+    if( tx_mode == TX_PER_BYTE || count <= 1 )
+    {
+        return transport::p_writev( chunks, count );
+    }
+    for( size_t i = 0; i < count; ++i )
+    {
+        batch.insert( batch.end(), chunks[i].data, chunks[i].data + chunks[i].size );
+    }
+    done = write_frame( &batch[0], batch.size() );
+    if( capture.is_open() )
+    {
+        capture.record( CAPTURE_TX, &batch[0], done, getTime() );
+    }
+    return done;
+}
+
+
 size_t serial_port::p_read( uint8_t * data, size_t size )
 {
+    size_t count = 0;
+
+    p_read_timed( data, size, -1, count );
+    return count;
+}
+
+
+serial_port::read_status_t serial_port::p_read_timed( uint8_t * data, size_t size, int timeout_ms, size_t & count )
+{
+    read_status_t status = read_timed( data, size, timeout_ms, count );
+
+    if( capture.is_open() && count > 0 )
+    {
+        capture.record( CAPTURE_RX, data, count, getTime() );
+    }
+    return status;
+}
+
+
+serial_port::read_status_t serial_port::read_timed( uint8_t * data, size_t size, int timeout_ms, size_t & count )
+{
+    COMMTIMEOUTS timeouts = { 0 };
     DWORD bytesRead = 0;
 
+    count = 0;
     if( fd == INVALID_HANDLE_VALUE )
     {
         cout<<"Error reading from closed port"<<endl;
+        return READ_ERROR;
     }
 
+    /* All zero blocks until size bytes arrive; MAXDWORD between bytes
+       with no total timeout returns at once with whatever is there */
+    GetCommTimeouts( fd, &timeouts );
+    timeouts.ReadIntervalTimeout        = timeout_ms == 0 ? MAXDWORD : 0;
+    timeouts.ReadTotalTimeoutMultiplier = 0;
+    timeouts.ReadTotalTimeoutConstant   = timeout_ms < 0 ? 0 : timeout_ms;
+    SetCommTimeouts( fd, &timeouts );
+
     if( !ReadFile( fd, data, size, &bytesRead, NULL ) )
     {
-        return 0;
+        return READ_ERROR;
     }
 
-    return bytesRead;
+    count = bytesRead;
+    return count == size ? READ_OK : READ_TIMEOUT;
 }
 
 
-const uint64_t serial_port::getTime( void )
+void serial_port::flush_input()
 {
-    timeval tv;
-    gettimeofday( &tv, NULL );
-    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec ;
+    if( fd != INVALID_HANDLE_VALUE )
+    {
+        PurgeComm( fd, PURGE_RXCLEAR );
+    }
+}
+
+
+uint64_t serial_port::pace_until( uint64_t deadline )
+{
+    uint64_t now = getTime();
+    uint64_t lateness;
+
+    if( now < deadline )
+    {
+        Sleep( ( deadline - now + 999 ) / 1000 );
+        now = getTime();
+    }
+
+    lateness = now > deadline ? now - deadline : 0;
+    pacing.paced++;
+    pacing.total_lateness += lateness;
+    pacing.lateness.add( lateness * 1000 );
+    if( lateness > pacing.max_lateness )
+    {
+        pacing.max_lateness = lateness;
+    }
+    if( lateness > CONSTRAINT_USECS )
+    {
+        pacing.late++;
+    }
+    return lateness;
+}
+
+
+const pacing_stats & serial_port::get_pacing_stats() const
+{
+    return pacing;
+}
+
+
+void serial_port::reset_pacing_stats()
+{
+    memset( &pacing, 0x00, sizeof( pacing ) );
 }
 
 
@@ -168,3 +346,83 @@ int serial_port::delay( int usecs )
     Sleep((usecs+999)/1000);
     return 0;
 }
+
+
+bool serial_port::start_capture( const string & filename )
+{
+    return capture.open( filename, getTime() );
+}
+
+
+void serial_port::stop_capture()
+{
+    capture.close();
+}
+
+
+void serial_port::record( capture_dir dir, const uint8_t * data, size_t size )
+{
+    if( capture.is_open() && size > 0 )
+    {
+        capture.record( dir, data, size, getTime() );
+    }
+}
+
+
+void serial_port::set_tx_mode( tx_mode_t mode )
+{
+    tx_mode = mode;
+}
+
+
+serial_port::tx_mode_t serial_port::get_tx_mode() const
+{
+    return tx_mode;
+}
+
+
+void serial_port::set_byte_gap( int usecs )
+{
+    byte_gap = usecs;
+}
+
+
+int serial_port::get_byte_gap() const
+{
+    return byte_gap;
+}
+
+
+bool serial_port::set_link_rate( int rate )
+{
+    DCB dcb = { 0 };
+
+    if( rate <= 0 )
+    {
+        return false;
+    }
+    link_rate = rate;
+    dcb.DCBlength = sizeof( dcb );
+    if( fd == INVALID_HANDLE_VALUE || !GetCommState( fd, &dcb ) )
+    {
+        return false;
+    }
+    dcb.BaudRate = rate;
+    return SetCommState( fd, &dcb );
+}
+
+
+int serial_port::get_link_rate() const
+{
+    return link_rate;
+}
+
+
+int serial_port::byte_time() const
+{
+    if( byte_gap > 0 )
+    {
+        return byte_gap;
+    }
+    return ( BITS_PER_BYTE * 1000000 + link_rate - 1 ) / link_rate;
+}
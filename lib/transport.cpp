@@ -0,0 +1,210 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "transport.hpp"
+#include <cstring>
+#include <sys/time.h>
+#include <time.h>
+
+using std::size_t;
+
+static const uint8_t ack[5] = { 0x04, 0x40, 0x00, 0x00, 0x00 };
+
+transport::~transport()
+{
+}
+
+
+size_t transport::p_writev( const io_chunk * chunks, size_t count )
+{
+    size_t total = 0;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        size_t written = p_write( chunks[i].data, chunks[i].size );
+
+        total += written;
+        if( written != chunks[i].size )
+        {
+            break;
+        }
+    }
+    return total;
+}
+
+
+const uint64_t transport::getTime( void )
+{
+    #if( __linux )
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000 ;
+    #else
+    timeval tv;
+    gettimeofday( &tv, NULL );
+    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec ;
+    #endif
+}
+
+
+loopback_transport::loopback_transport()
+{
+    bytes       = 0;
+    frames      = 0;
+    frame_left  = 0;
+    frame_first = false;
+    frame_acked = false;
+    ack_bytes   = 0;
+}
+
+
+bool loopback_transport::is_open()
+{
+    return true;
+}
+
+
+size_t loopback_transport::p_write( const uint8_t * data, size_t size )
+{
+    parse( data, size );
+    return size;
+}
+
+
+/* Every complete 0x40 command earns an ack, start and stop do not */
+void loopback_transport::parse( const uint8_t * data, size_t size )
+{
+    size_t i;
+
+    bytes += size;
+    for( i = 0; i < size; ++i )
+    {
+        if( frame_left == 0 )
+        {
+            frame_left  = data[i];
+            frame_first = true;
+            continue;
+        }
+        if( frame_first )
+        {
+            frame_acked = ( data[i] == 0x40 );
+            frame_first = false;
+        }
+        if( --frame_left == 0 )
+        {
+            frames++;
+            if( frame_acked )
+            {
+                ack_bytes += sizeof( ack );
+            }
+        }
+    }
+}
+
+
+transport::read_status_t loopback_transport::p_read_timed( uint8_t * data, size_t size, int timeout_ms, size_t & count )
+{
+    for( count = 0; count < size && ack_bytes > 0; ++count, --ack_bytes )
+    {
+        data[ count ] = ack[ ( sizeof( ack ) - ack_bytes % sizeof( ack ) ) % sizeof( ack ) ];
+    }
+    return count == size ? READ_OK : READ_TIMEOUT;
+}
+
+
+void loopback_transport::flush_input()
+{
+    ack_bytes = 0;
+}
+
+
+int loopback_transport::delay( int usecs )
+{
+    return 0;
+}
+
+
+file_transport::file_transport()
+{
+    out = NULL;
+}
+
+
+file_transport::file_transport( const std::string & filename )
+{
+    out = NULL;
+    p_open( filename );
+}
+
+
+file_transport::~file_transport()
+{
+    p_close();
+}
+
+
+void file_transport::p_open( const std::string & filename )
+{
+    p_close();
+    if( filename == "-" )
+    {
+        out = stdout;
+    }
+    else
+    {
+        out = fopen( filename.c_str(), "wb" );
+    }
+}
+
+
+void file_transport::p_close()
+{
+    if( out != NULL && out != stdout )
+    {
+        fclose( out );
+    }
+    else if( out != NULL )
+    {
+        fflush( out );
+    }
+    out = NULL;
+}
+
+
+bool file_transport::is_open()
+{
+    return out != NULL;
+}
+
+
+size_t file_transport::p_write( const uint8_t * data, size_t size )
+{
+    if( out == NULL )
+    {
+        return 0;
+    }
+    size = fwrite( data, 1, size, out );
+    parse( data, size );
+    return size;
+}
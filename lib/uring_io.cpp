@@ -0,0 +1,443 @@
+/*
+ * libcutter - xy cutter control library
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+#include "uring_io.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+using std::size_t;
+
+enum
+{
+    TAG_WRITE = 1,
+    TAG_READ,
+    TAG_TIMEOUT
+};
+
+enum
+{
+    BUF_TX = 0,
+    BUF_RX
+};
+
+
+uring_io::uring_io()
+{
+    ring_fd = -1;
+    sq_map  = NULL;
+    cq_map  = NULL;
+    sqes    = NULL;
+    tx_buf  = NULL;
+    rx_buf  = NULL;
+
+    write_done   = true;
+    write_failed = false;
+    read_done    = true;
+    timeout_done = true;
+}
+
+
+uring_io::~uring_io()
+{
+    teardown();
+}
+
+
+bool uring_io::setup( int fd, bool use_sqpoll )
+{
+    io_uring_params params;
+    iovec           bufs[2];
+
+    memset( &params, 0x00, sizeof( params ) );
+    if( use_sqpoll )
+    {
+        params.flags          = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 1000;
+    }
+    ring_fd = syscall( __NR_io_uring_setup, ENTRIES, &params );
+    if( ring_fd < 0 && use_sqpoll )
+    {
+        //SQ polling needs privileges on older kernels
+        use_sqpoll   = false;
+        params.flags = 0;
+        ring_fd = syscall( __NR_io_uring_setup, ENTRIES, &params );
+    }
+    if( ring_fd < 0 )
+    {
+        return false;
+    }
+    sqpoll    = use_sqpoll;
+    to_submit = 0;
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        sq_map_size = cq_map_size = sq_map_size > cq_map_size ? sq_map_size : cq_map_size;
+    }
+    sq_map = mmap( NULL, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING );
+    if( sq_map == MAP_FAILED )
+    {
+        sq_map = NULL;
+        teardown();
+        return false;
+    }
+    if( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        cq_map = sq_map;
+    }
+    else
+    {
+        cq_map = mmap( NULL, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING );
+        if( cq_map == MAP_FAILED )
+        {
+            cq_map = NULL;
+            teardown();
+            return false;
+        }
+    }
+    sqes_size = params.sq_entries * sizeof( io_uring_sqe );
+    sqes = (io_uring_sqe *)mmap( NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES );
+    if( sqes == MAP_FAILED )
+    {
+        sqes = NULL;
+        teardown();
+        return false;
+    }
+
+    uint8_t * sq = (uint8_t *)sq_map;
+    uint8_t * cq = (uint8_t *)cq_map;
+    sq_head  = (unsigned *)( sq + params.sq_off.head );
+    sq_tail  = (unsigned *)( sq + params.sq_off.tail );
+    sq_mask  = (unsigned *)( sq + params.sq_off.ring_mask );
+    sq_flags = (unsigned *)( sq + params.sq_off.flags );
+    sq_array = (unsigned *)( sq + params.sq_off.array );
+    cq_head  = (unsigned *)( cq + params.cq_off.head );
+    cq_tail  = (unsigned *)( cq + params.cq_off.tail );
+    cq_mask  = (unsigned *)( cq + params.cq_off.ring_mask );
+    cqes     = (io_uring_cqe *)( cq + params.cq_off.cqes );
+
+    if( posix_memalign( (void **)&tx_buf, 4096, TX_BYTES + RX_BYTES ) != 0 )
+    {
+        tx_buf = NULL;
+        teardown();
+        return false;
+    }
+    rx_buf = tx_buf + TX_BYTES;
+    bufs[ BUF_TX ].iov_base = tx_buf;
+    bufs[ BUF_TX ].iov_len  = TX_BYTES;
+    bufs[ BUF_RX ].iov_base = rx_buf;
+    bufs[ BUF_RX ].iov_len  = RX_BYTES;
+    if( syscall( __NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, bufs, 2 ) != 0 ||
+        syscall( __NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, &fd, 1 ) != 0 )
+    {
+        teardown();
+        return false;
+    }
+
+    tx_off = 0;
+    return true;
+}
+
+
+void uring_io::teardown()
+{
+    if( ring_fd >= 0 && sqes != NULL && cq_map != NULL )
+    {
+        //Let anything still queued finish before its buffers go away
+        wait_for( write_done );
+        wait_for( read_done );
+        wait_for( timeout_done );
+    }
+    if( sqes != NULL )
+    {
+        munmap( sqes, sqes_size );
+        sqes = NULL;
+    }
+    if( cq_map != NULL && cq_map != sq_map )
+    {
+        munmap( cq_map, cq_map_size );
+    }
+    cq_map = NULL;
+    if( sq_map != NULL )
+    {
+        munmap( sq_map, sq_map_size );
+        sq_map = NULL;
+    }
+    if( ring_fd >= 0 )
+    {
+        close( ring_fd );
+        ring_fd = -1;
+    }
+    free( tx_buf );
+    tx_buf = NULL;
+    rx_buf = NULL;
+}
+
+
+/* The SQE ahead slots past the tail, cleared; it only reaches the kernel
+   once sq_tail is moved past it */
+io_uring_sqe * uring_io::get_sqe( unsigned ahead )
+{
+    unsigned tail = *sq_tail + ahead;
+
+    if( tail - __atomic_load_n( sq_head, __ATOMIC_ACQUIRE ) >= ENTRIES )
+    {
+        return NULL;
+    }
+    io_uring_sqe * sqe = &sqes[ tail & *sq_mask ];
+    memset( sqe, 0x00, sizeof( *sqe ) );
+    sq_array[ tail & *sq_mask ] = tail & *sq_mask;
+    return sqe;
+}
+
+
+/* Publish the SQEs filled since the last call and optionally wait for
+   completions; skips the system call when there is nothing to do */
+bool uring_io::enter( unsigned wait )
+{
+    unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int r;
+
+    if( sqpoll )
+    {
+        __atomic_thread_fence( __ATOMIC_SEQ_CST );
+        if( to_submit > 0 && ( __atomic_load_n( sq_flags, __ATOMIC_RELAXED ) & IORING_SQ_NEED_WAKEUP ) )
+        {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+        to_submit = 0;
+        if( flags == 0 )
+        {
+            return true;
+        }
+    }
+    else if( to_submit == 0 && wait == 0 )
+    {
+        return true;
+    }
+
+    do
+    {
+        r = syscall( __NR_io_uring_enter, ring_fd, sqpoll ? 0 : to_submit, wait, flags, NULL, 0 );
+    } while( r < 0 && errno == EINTR );
+
+    if( r < 0 )
+    {
+        return false;
+    }
+    if( !sqpoll )
+    {
+        to_submit -= (unsigned)r < to_submit ? r : to_submit;
+    }
+    return true;
+}
+
+
+void uring_io::reap()
+{
+    unsigned head = *cq_head;
+
+    while( head != __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE ) )
+    {
+        const io_uring_cqe & cqe = cqes[ head & *cq_mask ];
+
+        switch( cqe.user_data )
+        {
+            case TAG_WRITE:
+                write_done = true;
+                if( cqe.res < 0 )
+                {
+                    write_failed = true;
+                }
+                break;
+
+            case TAG_READ:
+                read_done   = true;
+                read_result = cqe.res;
+                break;
+
+            case TAG_TIMEOUT:
+                timeout_done = true;
+                break;
+        }
+        head++;
+    }
+    __atomic_store_n( cq_head, head, __ATOMIC_RELEASE );
+}
+
+
+bool uring_io::wait_for( const bool & flag )
+{
+    reap();
+    while( !flag )
+    {
+        if( !enter( 1 ) )
+        {
+            return false;
+        }
+        reap();
+    }
+    return true;
+}
+
+
+bool uring_io::write( const uint8_t * data, size_t size )
+{
+    io_chunk chunk;
+
+    chunk.data = data;
+    chunk.size = size;
+    return write( &chunk, 1 );
+}
+
+
+/* Chunks are gathered into the transmit ring, so they still go out in
+   a single WRITE_FIXED */
+bool uring_io::write( const io_chunk * chunks, size_t count )
+{
+    io_uring_sqe * sqe;
+    size_t size = 0;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        size += chunks[i].size;
+    }
+    if( size > TX_BYTES || !wait_for( write_done ) )
+    {
+        return false;
+    }
+    if( write_failed )
+    {
+        write_failed = false;
+        return false;
+    }
+    if( tx_off + size > TX_BYTES )
+    {
+        tx_off = 0;
+    }
+    sqe = get_sqe();
+    if( sqe == NULL )
+    {
+        return false;
+    }
+    for( size_t i = 0, off = tx_off; i < count; off += chunks[i].size, ++i )
+    {
+        memcpy( tx_buf + off, chunks[i].data, chunks[i].size );
+    }
+
+    sqe->opcode    = IORING_OP_WRITE_FIXED;
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = 0;
+    sqe->addr      = (uint64_t)(uintptr_t)( tx_buf + tx_off );
+    sqe->len       = size;
+    sqe->buf_index = BUF_TX;
+    sqe->user_data = TAG_WRITE;
+    __atomic_store_n( sq_tail, *sq_tail + 1, __ATOMIC_RELEASE );
+    to_submit++;
+    tx_off    += size;
+    write_done = false;
+
+    return enter( 0 );
+}
+
+
+/*
+ * With the port set to VMIN=1 a read completes as soon as anything
+ * arrives, and the linked timeout cancels it at the deadline. Submitting
+ * and waiting is a single io_uring_enter(), with no poll() or timer.
+ */
+transport::read_status_t uring_io::read( uint8_t * data, size_t size, uint64_t deadline, size_t & count )
+{
+    count = 0;
+    reap();
+    if( write_failed )
+    {
+        write_failed = false;
+        return transport::READ_ERROR;
+    }
+
+    while( count < size )
+    {
+        size_t want = size - count < RX_BYTES ? size - count : RX_BYTES;
+        io_uring_sqe * sqe  = get_sqe( 0 );
+        io_uring_sqe * link = deadline != 0 ? get_sqe( 1 ) : NULL;
+        unsigned used = link != NULL ? 2 : 1;
+
+        //A read with a deadline never goes out without its timeout
+        if( sqe == NULL || ( deadline != 0 && link == NULL ) )
+        {
+            return transport::READ_ERROR;
+        }
+        sqe->opcode    = IORING_OP_READ_FIXED;
+        sqe->flags     = IOSQE_FIXED_FILE;
+        sqe->fd        = 0;
+        sqe->addr      = (uint64_t)(uintptr_t)rx_buf;
+        sqe->len       = want;
+        sqe->buf_index = BUF_RX;
+        sqe->user_data = TAG_READ;
+        if( link != NULL )
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+            timeout.tv_sec  = deadline / 1000000;
+            timeout.tv_nsec = ( deadline % 1000000 ) * 1000;
+            link->opcode        = IORING_OP_LINK_TIMEOUT;
+            link->fd            = -1;
+            link->addr          = (uint64_t)(uintptr_t)&timeout;
+            link->len           = 1;
+            link->timeout_flags = IORING_TIMEOUT_ABS;
+            link->user_data     = TAG_TIMEOUT;
+            timeout_done = false;
+        }
+        //Both SQEs are complete before the kernel can see either
+        __atomic_store_n( sq_tail, *sq_tail + used, __ATOMIC_RELEASE );
+        to_submit += used;
+        read_done = false;
+
+        if( !wait_for( read_done ) || !wait_for( timeout_done ) )
+        {
+            return transport::READ_ERROR;
+        }
+        if( read_result > 0 )
+        {
+            memcpy( data + count, rx_buf, read_result );
+            count += read_result;
+        }
+        else if( read_result == -ECANCELED || read_result == -EINTR || read_result == -ETIME )
+        {
+            return transport::READ_TIMEOUT;
+        }
+        else
+        {
+            return transport::READ_ERROR;
+        }
+    }
+    return transport::READ_OK;
+}
@@ -0,0 +1,372 @@
+/*
+ * bench_encode - time the command encryption and framing path
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+/*
+ * Times every layer of turning a point into a wire frame: generic btea(),
+ * the fixed size btea3 kernels one payload at a time and in batches on
+ * each vector unit the CPU has, the htocl() byte order step, and whole
+ * Device::C frames, with and without the frame cache, and over the
+ * loopback transport. Each case is run several times and reported in ns
+ * per packet, best and median; -k prints one key=value line per case for
+ * scripts that track it between releases.
+ * Build with CMAKE_BUILD_TYPE=Release for numbers worth comparing.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "btea.h"
+#include "device_c.hpp"
+#include "transport.hpp"
+#include "command_stats.hpp"
+#include "keys.h"
+
+using std::cout;
+using std::endl;
+
+static const uint32_t bench_key[4] = { 0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210 };
+
+static int      packets  = 200000;
+static int      reps     = 5;
+static bool     keyvalue = false;
+static uint32_t sink;
+
+/* One cutter for every case, so only the work being timed is repeated */
+static loopback_transport loopback;
+static Device::C        * cutter;
+
+struct bench_result
+{
+    double best;
+    double median;
+};
+
+typedef uint64_t ( * bench_fn )( int batch, std::vector<lmc_command> & frames );
+
+static void usage( const char * progname )
+{
+    cout << "usage: " << progname << " [options]" << endl;
+    cout << "  -n packets  packets per timed run (default 200000)" << endl;
+    cout << "  -r reps     timed runs per case, best and median kept (default 5)" << endl;
+    cout << "  -b list     comma separated batch sizes (default 1,4,8,16,64,256)" << endl;
+    cout << "  -k          print one key=value line per case" << endl;
+    exit( 1 );
+}
+
+
+static void fill_frames( std::vector<lmc_command> & frames )
+{
+    uint32_t seed = 0x12345678;
+
+    for( std::size_t i = 0; i < frames.size(); ++i )
+    {
+        frames[i].bytes = 13;
+        frames[i].cmd   = 0x40;
+        for( int j = 0; j < 3; ++j )
+        {
+            seed = seed * 1103515245 + 12345;
+            frames[i].data[j] = seed;
+        }
+    }
+}
+
+
+/* Each bench_fn encodes packets frames in groups of batch and returns
+   the nanoseconds it took. The one payload kernels want an aligned
+   uint32_t[3], which a packed frame is not, so they pay for copying the
+   payload out and back as any caller holding frames would. */
+
+static uint64_t bench_btea( int batch, std::vector<lmc_command> & frames )
+{
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; ++i )
+    {
+        uint32_t v[3];
+        lmc_command & l = frames[ i % frames.size() ];
+        memcpy( v, l.data, sizeof( v ) );
+        btea( v, 3, bench_key );
+        memcpy( l.data, v, sizeof( v ) );
+    }
+    return stats_clock() - begin;
+}
+
+static uint64_t bench_btea3( int batch, std::vector<lmc_command> & frames )
+{
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; ++i )
+    {
+        uint32_t v[3];
+        lmc_command & l = frames[ i % frames.size() ];
+        memcpy( v, l.data, sizeof( v ) );
+        btea3_encrypt( v, bench_key );
+        memcpy( l.data, v, sizeof( v ) );
+    }
+    return stats_clock() - begin;
+}
+
+static uint64_t bench_btea3_scheduled( int batch, std::vector<lmc_command> & frames )
+{
+    btea3_schedule ks;
+    uint64_t begin = stats_clock();
+
+    btea3_schedule_init( &ks, bench_key );
+    for( int i = 0; i < packets; ++i )
+    {
+        uint32_t v[3];
+        lmc_command & l = frames[ i % frames.size() ];
+        memcpy( v, l.data, sizeof( v ) );
+        btea3_encrypt_scheduled( v, &ks );
+        memcpy( l.data, v, sizeof( v ) );
+    }
+    return stats_clock() - begin;
+}
+
+static uint64_t bench_btea3_batch( int batch, std::vector<lmc_command> & frames )
+{
+    btea3_schedule ks;
+    std::size_t at = 0;
+    uint64_t begin = stats_clock();
+
+    btea3_schedule_init( &ks, bench_key );
+    for( int i = 0; i < packets; i += batch )
+    {
+        if( at + batch > frames.size() )
+        {
+            at = 0;
+        }
+        btea3_encrypt_batch_scheduled( frames[ at ].data, batch, sizeof( lmc_command ), &ks );
+        at += batch;
+    }
+    return stats_clock() - begin;
+}
+
+static uint64_t bench_htocl( int batch, std::vector<lmc_command> & frames )
+{
+    uint32_t sum = 0;
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; ++i )
+    {
+        const lmc_command & l = frames[ i % frames.size() ];
+        sum += htocl( l.data[0] ) ^ htocl( l.data[1] ) ^ htocl( l.data[2] );
+    }
+    sink += sum;
+    return stats_clock() - begin;
+}
+
+
+static xy bench_point( int i )
+{
+    return xy( ( i % 997 ) * 0.01, ( i % 991 ) * 0.01 );
+}
+
+/* Point to finished frame, no I/O */
+static uint64_t bench_frame( int batch, std::vector<lmc_command> & frames )
+{
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; ++i )
+    {
+        cutter->encode_frame( bench_point( i ), Device::CMD_CUT, frames[ i % frames.size() ] );
+    }
+    return stats_clock() - begin;
+}
+
+/* The same over a path that keeps coming back to 1000 points, with the
+   frame cache on, so all but the first pass are hits */
+static uint64_t bench_frame_cached( int batch, std::vector<lmc_command> & frames )
+{
+    cutter->set_frame_cache( 4096 );
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; ++i )
+    {
+        cutter->encode_frame( bench_point( i % 1000 ), Device::CMD_CUT, frames[ i % frames.size() ] );
+    }
+    uint64_t end = stats_clock();
+    cutter->set_frame_cache( 0 );
+    return end - begin;
+}
+
+/* Commands through submit() to the loopback, which acks at once */
+static uint64_t bench_submit( int batch, std::vector<lmc_command> & frames )
+{
+    std::vector<Device::command> cmds( batch );
+    uint64_t begin = stats_clock();
+
+    for( int i = 0; i < packets; i += batch )
+    {
+        for( int j = 0; j < batch; ++j )
+        {
+            cmds[j].type  = Device::CMD_CUT;
+            cmds[j].pt[0] = bench_point( i + j );
+        }
+        if( cutter->submit( &cmds[0], batch ) != (std::size_t)batch )
+        {
+            cout << "submit to loopback failed" << endl;
+            exit( 2 );
+        }
+    }
+    cutter->wait_idle();
+    return stats_clock() - begin;
+}
+
+
+static bench_result run( bench_fn fn, int batch )
+{
+    std::vector<lmc_command> frames( std::max( batch, 4096 ) );
+    std::vector<double> ns;
+
+    fill_frames( frames );
+    fn( batch, frames );
+    for( int r = 0; r < reps; ++r )
+    {
+        int done = ( packets + batch - 1 ) / batch * batch;
+        ns.push_back( (double)fn( batch, frames ) / done );
+    }
+    std::sort( ns.begin(), ns.end() );
+
+    bench_result result;
+    result.best   = ns[0];
+    result.median = ns[ ns.size() / 2 ];
+    return result;
+}
+
+static void report( const char * name, const char * impl, int batch, const bench_result & result )
+{
+    if( keyvalue )
+    {
+        printf( "bench=%s impl=%s batch=%d packets=%d reps=%d ns_best=%.2f ns_median=%.2f\n",
+            name, impl, batch, packets, reps, result.best, result.median );
+    }
+    else
+    {
+        printf( "%-16s %-7s %6d %10.2f %10.2f\n", name, impl, batch, result.best, result.median );
+    }
+    fflush( stdout );
+}
+
+
+int main( int argc, char * argv[] )
+{
+    std::vector<int> batches;
+    int opt;
+
+    while( ( opt = getopt( argc, argv, "n:r:b:k" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'n': packets  = atoi( optarg ); break;
+            case 'r': reps     = atoi( optarg ); break;
+            case 'k': keyvalue = true;           break;
+            case 'b':
+            {
+                std::string list = optarg;
+                std::size_t at = 0;
+                while( at <= list.size() )
+                {
+                    std::size_t comma = list.find( ',', at );
+                    if( comma == std::string::npos )
+                    {
+                        comma = list.size();
+                    }
+                    int batch = atoi( list.substr( at, comma - at ).c_str() );
+                    if( batch > 0 )
+                    {
+                        batches.push_back( batch );
+                    }
+                    at = comma + 1;
+                }
+                break;
+            }
+            default:
+                usage( argv[0] );
+        }
+    }
+    if( packets <= 0 || reps <= 0 || optind != argc )
+    {
+        usage( argv[0] );
+    }
+    if( batches.empty() )
+    {
+        static const int defaults[] = { 1, 4, 8, 16, 64, 256 };
+        batches.assign( defaults, defaults + sizeof( defaults ) / sizeof( defaults[0] ) );
+    }
+
+    const btea3_impl native = btea3_get_impl();
+
+    cutter = new Device::C();
+    cutter->set_transport( &loopback );
+    ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
+    cutter->set_move_key(move_key);
+    ckey_type line_key={LINE_KEY_0, LINE_KEY_1, LINE_KEY_2, LINE_KEY_3 };
+    cutter->set_line_key(line_key);
+    ckey_type curve_key={CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 };
+    cutter->set_curve_key(curve_key);
+    cutter->start();
+
+    if( !keyvalue )
+    {
+        printf( "%d packets x %d runs, btea3 kernel %s by default\n",
+            packets, reps, btea3_impl_name( native ) );
+        printf( "%-16s %-7s %6s %10s %10s\n", "bench", "impl", "batch", "best ns", "median ns" );
+    }
+
+    report( "btea",           "generic", 1, run( bench_btea, 1 ) );
+    report( "btea3",          "scalar",  1, run( bench_btea3, 1 ) );
+    report( "btea3_scheduled", "scalar", 1, run( bench_btea3_scheduled, 1 ) );
+    report( "htocl",          "-",       1, run( bench_htocl, 1 ) );
+    report( "frame", btea3_impl_name( native ), 1, run( bench_frame, 1 ) );
+    report( "frame_cached", btea3_impl_name( native ), 1, run( bench_frame_cached, 1 ) );
+
+    for( int impl = 0; impl < BTEA3_NUM_IMPLS; ++impl )
+    {
+        if( !btea3_set_impl( (btea3_impl)impl ) )
+        {
+            continue;
+        }
+        const char * name = btea3_impl_name( (btea3_impl)impl );
+
+        for( std::size_t b = 0; b < batches.size(); ++b )
+        {
+            report( "btea3_batch", name, batches[b], run( bench_btea3_batch, batches[b] ) );
+        }
+        for( std::size_t b = 0; b < batches.size(); ++b )
+        {
+            report( "submit", name, batches[b], run( bench_submit, batches[b] ) );
+        }
+    }
+    btea3_set_impl( native );
+    delete cutter;
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * cutter_calibrate - find the fastest link rate a cutter keeps up with
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+
+#include "device_c.hpp"
+#include "link_rate.hpp"
+#include "keys.h"
+
+using std::cout;
+using std::endl;
+
+static const int default_rates[] = { 38400, 57600, 115200, 150000, 200000, 250000, 300000, 400000, 500000 };
+
+static void usage( const char * progname )
+{
+    cout << "usage: " << progname << " [-n trials] [-w window] [-s] device [rate ...]" << endl;
+    cout << "  -n  moves sent at each rate (default 50)" << endl;
+    cout << "  -w  commands kept in flight (default 1)" << endl;
+    cout << "  -s  save the fastest stable rate for this device (" << link_rate_file() << ")" << endl;
+    exit( 1 );
+}
+
+
+int main( int argc, char * argv[] )
+{
+    int  trials = 50;
+    int  window = 1;
+    bool save   = false;
+    int  opt;
+
+    while( ( opt = getopt( argc, argv, "n:w:s" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'n':
+                trials = atoi( optarg );
+                break;
+            case 'w':
+                window = atoi( optarg );
+                break;
+            case 's':
+                save = true;
+                break;
+            default:
+                usage( argv[0] );
+        }
+    }
+    if( optind >= argc )
+    {
+        usage( argv[0] );
+    }
+
+    const char * device = argv[ optind++ ];
+    std::vector<int> rates;
+    for( ; optind < argc; ++optind )
+    {
+        rates.push_back( atoi( argv[ optind ] ) );
+    }
+    if( rates.empty() )
+    {
+        rates.assign( default_rates, default_rates + sizeof( default_rates ) / sizeof( default_rates[0] ) );
+    }
+
+    Device::C cutter( device );
+    if( !cutter.is_open() )
+    {
+        cout << "Port not open" << endl;
+        return 2;
+    }
+
+    ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
+    cutter.set_move_key(move_key);
+    cutter.set_window( window );
+
+    std::vector<link_trial> results( rates.size() );
+    int best = cutter.calibrate_link_rate( &rates[0], rates.size(), trials, &results[0] );
+
+    printf( "%10s %8s %8s %12s %12s\n", "rate", "sent", "acked", "rtt mean us", "rtt p99 us" );
+    for( std::size_t i = 0; i < results.size(); ++i )
+    {
+        printf( "%10d %8d %8d %12.1f %12.1f\n", results[i].rate, results[i].sent,
+            results[i].acked, results[i].rtt_mean, results[i].rtt_p99 );
+    }
+
+    if( best == 0 )
+    {
+        cout << "no rate was stable" << endl;
+        return 3;
+    }
+    //The driver may only get near the rate asked for; save what it set
+    int actual = cutter.get_link_rate();
+    cout << "fastest stable rate: " << best;
+    if( actual != best )
+    {
+        cout << " (driver set " << actual << ")";
+    }
+    cout << endl;
+    if( save )
+    {
+        if( !save_link_rate( device, actual ) )
+        {
+            cout << "could not write " << link_rate_file() << endl;
+            return 4;
+        }
+        cout << "saved to " << link_rate_file() << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * cutter_emu - Device C firmware emulator on a pseudo-terminal
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+/*
+ * Opens a pty pair and behaves like the cutter on the slave side: start
+ * and stop frames are accepted silently, 0x40 commands are decrypted with
+ * each of the configured keys to find out what they are, and acked after
+ * a configurable delay. Point any of the util programs at the printed
+ * device path instead of /dev/ttyUSB0.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btea.h"
+#include "types.h"
+#include "lmc_command.hpp"
+#include "keys.h"
+
+using namespace std;
+
+#define C_UNITS_PER_INCH 404.0
+#define PADDING          12345
+
+enum frame_kind
+{
+    KIND_MOVE,
+    KIND_LINE,
+    KIND_CURVE,
+    KIND_UNKNOWN,
+    NUM_KINDS
+};
+
+static const char * const kind_names[ NUM_KINDS ] = { "move", "line", "curve", "unknown" };
+
+struct job_stats
+{
+    uint64_t first;
+    uint64_t last;
+    uint64_t bytes;
+    uint64_t commands[ NUM_KINDS ];
+    uint64_t acks_dropped;
+    uint64_t overflows;
+    uint64_t overruns;
+};
+
+static bool          should_exit;
+static job_stats     job;
+static FILE        * trajectory;
+
+static void catch_sigint( int signal )
+{
+    should_exit = true;
+}
+
+
+static uint64_t now_usecs( void )
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+static void usage( const char * progname )
+{
+    printf( "Usage: %s [options]\n", progname );
+    printf( "  -l usecs   ack latency after a command arrives (default 1000)\n" );
+    printf( "  -j usecs   random jitter added to each ack (default 0)\n" );
+    printf( "  -p percent chance of dropping an ack (default 0)\n" );
+    printf( "  -b depth   commands the firmware buffers; more are dropped (default 16)\n" );
+    printf( "  -S in/sec  hold each ack until the motion would finish (default off)\n" );
+    printf( "  -r bits/s  fastest link the firmware keeps up with; frames arriving\n" );
+    printf( "             closer together than that are lost (default off)\n" );
+    printf( "  -s path    also make the slave reachable through a symlink\n" );
+    printf( "  -o file    log the decoded trajectory to file ('-' for stdout)\n" );
+    exit( 1 );
+}
+
+
+static void print_job( void )
+{
+    uint64_t total = 0;
+    double   secs  = ( job.last - job.first ) / 1000000.0;
+
+    for( int i = 0; i < NUM_KINDS; ++i )
+    {
+        total += job.commands[i];
+    }
+    if( total == 0 )
+    {
+        return;
+    }
+
+    printf( "job: %llu commands (%llu move, %llu line, %llu curve, %llu unknown), %llu bytes\n",
+        (unsigned long long)total,
+        (unsigned long long)job.commands[ KIND_MOVE ],
+        (unsigned long long)job.commands[ KIND_LINE ],
+        (unsigned long long)job.commands[ KIND_CURVE ],
+        (unsigned long long)job.commands[ KIND_UNKNOWN ],
+        (unsigned long long)job.bytes );
+    printf( "     %.3f s, %.1f commands/s, %llu acks dropped, %llu buffer overflows, %llu overruns\n",
+        secs, secs > 0 ? total / secs : 0.0,
+        (unsigned long long)job.acks_dropped,
+        (unsigned long long)job.overflows,
+        (unsigned long long)job.overruns );
+    fflush( stdout );
+}
+
+
+/* Work out which key a command was encrypted with from its padding word */
+static frame_kind decode( const lmc_command & frame, xy & pt )
+{
+    static const uint32_t keys[3][4] =
+    {
+        { MOVE_KEY_0,  MOVE_KEY_1,  MOVE_KEY_2,  MOVE_KEY_3  },
+        { LINE_KEY_0,  LINE_KEY_1,  LINE_KEY_2,  LINE_KEY_3  },
+        { CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 }
+    };
+
+    for( int i = 0; i < 3; ++i )
+    {
+        uint32_t v[3];
+
+        memcpy( v, frame.data, sizeof( v ) );
+        btea( v, -3, keys[i] );
+        if( htocl( v[0] ) == PADDING )
+        {
+            pt.x = (int32_t)htocl( v[2] ) / C_UNITS_PER_INCH;
+            pt.y = (int32_t)htocl( v[1] ) / C_UNITS_PER_INCH;
+            return (frame_kind)i;
+        }
+    }
+    return KIND_UNKNOWN;
+}
+
+
+int main( int argc, char * argv[] )
+{
+    int         latency  = 1000;
+    int         jitter   = 0;
+    int         loss     = 0;
+    int         depth    = 16;
+    double      speed    = 0;
+    int         max_rate = 0;
+    const char *linkname = NULL;
+    int         opt;
+
+    while( ( opt = getopt( argc, argv, "l:j:p:b:S:r:s:o:h" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'l': latency  = atoi( optarg ); break;
+            case 'j': jitter   = atoi( optarg ); break;
+            case 'p': loss     = atoi( optarg ); break;
+            case 'b': depth    = atoi( optarg ); break;
+            case 'S': speed    = atof( optarg ); break;
+            case 'r': max_rate = atoi( optarg ); break;
+            case 's': linkname = optarg;         break;
+            case 'o':
+                trajectory = strcmp( optarg, "-" ) == 0 ? stdout : fopen( optarg, "w" );
+                if( trajectory == NULL )
+                {
+                    perror( optarg );
+                    return 2;
+                }
+                break;
+            default:
+                usage( argv[0] );
+        }
+    }
+
+    int master = posix_openpt( O_RDWR | O_NOCTTY );
+    if( master < 0 || grantpt( master ) != 0 || unlockpt( master ) != 0 )
+    {
+        perror( "cutter_emu: pty" );
+        return 3;
+    }
+    const char * slave_name = ptsname( master );
+
+    /* Holding the slave open ourselves keeps the master from returning
+       EIO every time a client closes its end */
+    int slave = open( slave_name, O_RDWR | O_NOCTTY );
+    termios tio;
+    if( slave >= 0 && tcgetattr( slave, &tio ) == 0 )
+    {
+        cfmakeraw( &tio );
+        tcsetattr( slave, TCSANOW, &tio );
+    }
+
+    if( linkname != NULL )
+    {
+        unlink( linkname );
+        if( symlink( slave_name, linkname ) != 0 )
+        {
+            perror( linkname );
+        }
+    }
+
+    signal( SIGINT,  catch_sigint );
+    signal( SIGTERM, catch_sigint );
+    srandom( now_usecs() );
+
+    printf( "Emulating Device C on %s\n", linkname != NULL ? linkname : slave_name );
+    fflush( stdout );
+
+    static const uint8_t ack[5] = { 0x04, 0x40, 0x00, 0x00, 0x00 };
+    std::deque<uint64_t> acks;
+    uint8_t  buf[4096];
+    size_t   have = 0;
+    xy       position( 0, 0 );
+    uint64_t motion_done = 0;
+    uint64_t last_frame  = 0;
+
+    while( !should_exit )
+    {
+        pollfd   pfd;
+        int      wait_ms = 100;
+        uint64_t now = now_usecs();
+
+        while( !acks.empty() && acks.front() <= now )
+        {
+            acks.pop_front();
+            if( write( master, ack, sizeof( ack ) ) != sizeof( ack ) )
+            {
+                perror( "cutter_emu: write" );
+            }
+        }
+        if( !acks.empty() )
+        {
+            wait_ms = ( acks.front() - now + 999 ) / 1000;
+        }
+
+        pfd.fd     = master;
+        pfd.events = POLLIN;
+        if( poll( &pfd, 1, wait_ms ) <= 0 || !( pfd.revents & POLLIN ) )
+        {
+            continue;
+        }
+
+        ssize_t r = read( master, buf + have, sizeof( buf ) - have );
+        if( r <= 0 )
+        {
+            if( r < 0 && errno != EINTR && errno != EAGAIN )
+            {
+                usleep( 10000 );
+            }
+            continue;
+        }
+        have += r;
+        now   = now_usecs();
+
+        size_t used = 0;
+        while( have - used >= 1 )
+        {
+            uint8_t len = buf[ used ];
+
+            if( len != 0x04 && len != 0x0D )
+            {
+                printf( "resync: skipping stray byte 0x%02x\n", len );
+                used++;
+                continue;
+            }
+            if( have - used < (size_t)len + 1 )
+            {
+                break;
+            }
+
+            uint8_t cmd = buf[ used + 1 ];
+            if( len == 0x04 && ( cmd == 0x21 || cmd == 0x22 ) )
+            {
+                if( cmd == 0x21 )
+                {
+                    memset( &job, 0x00, sizeof( job ) );
+                    job.first = now;
+                }
+                else
+                {
+                    print_job();
+                    memset( &job, 0x00, sizeof( job ) );
+                }
+                if( trajectory != NULL )
+                {
+                    fprintf( trajectory, "%s\n", cmd == 0x21 ? "start" : "stop" );
+                    fflush( trajectory );
+                }
+            }
+            else if( len == 0x0D && cmd == 0x40 )
+            {
+                lmc_command frame;
+                xy          pt( 0, 0 );
+                frame_kind  kind;
+
+                memcpy( &frame, buf + used, sizeof( frame ) );
+                kind = decode( frame, pt );
+
+                if( job.first == 0 )
+                {
+                    job.first = now;
+                }
+                job.last   = now;
+                job.bytes += sizeof( frame );
+                job.commands[ kind ]++;
+
+                if( trajectory != NULL )
+                {
+                    fprintf( trajectory, "%s %f %f\n", kind_names[ kind ], pt.x, pt.y );
+                }
+
+                uint64_t due = now + latency;
+                if( jitter > 0 )
+                {
+                    due += random() % jitter;
+                }
+                if( speed > 0 && kind != KIND_UNKNOWN )
+                {
+                    double dist = sqrt( ( pt.x - position.x ) * ( pt.x - position.x ) +
+                        ( pt.y - position.y ) * ( pt.y - position.y ) );
+                    motion_done = ( motion_done > now ? motion_done : now ) + (uint64_t)( dist / speed * 1000000 );
+                    position = pt;
+                    if( motion_done > due )
+                    {
+                        due = motion_done;
+                    }
+                }
+                //The firmware acks in order
+                if( !acks.empty() && due < acks.back() )
+                {
+                    due = acks.back();
+                }
+
+                /* 11 bits per byte: start, 8 data, 2 stop */
+                bool overrun = max_rate > 0 &&
+                    now - last_frame < (uint64_t)sizeof( frame ) * 11 * 1000000 / max_rate;
+                last_frame = now;
+
+                if( overrun )
+                {
+                    job.overruns++;
+                }
+                else if( (int)acks.size() >= depth )
+                {
+                    job.overflows++;
+                }
+                else if( loss > 0 && random() % 100 < loss )
+                {
+                    job.acks_dropped++;
+                }
+                else
+                {
+                    acks.push_back( due );
+                }
+            }
+            else
+            {
+                printf( "unknown frame: length 0x%02x command 0x%02x\n", len, cmd );
+            }
+            used += len + 1;
+        }
+        memmove( buf, buf + used, have - used );
+        have -= used;
+    }
+
+    print_job();
+    if( trajectory != NULL && trajectory != stdout )
+    {
+        fclose( trajectory );
+    }
+    if( linkname != NULL )
+    {
+        unlink( linkname );
+    }
+    close( slave );
+    close( master );
+    return 0;
+}
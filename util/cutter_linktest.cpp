@@ -0,0 +1,426 @@
+/*
+ * cutter_linktest - measure sustained throughput to a cutter
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+/*
+ * Streams synthetic commands at a port and reports what the link
+ * sustained. Point it at a cutter, or at cutter_emu to qualify an
+ * adapter or a host without one.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "device_c.hpp"
+#include "transport.hpp"
+#include "keys.h"
+#if( __linux )
+#include "port_loop.hpp"
+#endif
+
+using std::cout;
+using std::endl;
+
+enum pattern_t
+{
+    PATTERN_MOVE,
+    PATTERN_LINE,
+    PATTERN_CURVE,
+    PATTERN_MIXED
+};
+
+static void usage( const char * progname )
+{
+    cout << "usage: " << progname << " [options] device [device...]" << endl;
+    cout << "  -n count    commands to send (default 1000)" << endl;
+    cout << "  -p pattern  move, line, curve or mixed (default move)" << endl;
+    cout << "  -a inches   size of the square the pattern stays in (default 1)" << endl;
+    cout << "  -w window   commands in flight (default 1)" << endl;
+    cout << "  -c frames   frames per write (default 1)" << endl;
+    cout << "  -t ms       ack timeout (default 1000)" << endl;
+    cout << "  -r retries  resends of an unacked move or line, window 1 only (default 0)" << endl;
+    cout << "  -R rate     link rate in bits/s (default: saved or built in)" << endl;
+    cout << "  -b          pace byte by byte instead of a frame per write" << endl;
+    cout << "  -T          send from a dedicated I/O thread" << endl;
+    cout << "  -k          print the summary as key=value lines" << endl;
+    cout << "device may be 'loopback' to measure the library alone. With several" << endl;
+    cout << "devices, one port_loop drives them all at once (-n, -p, -a, -w, -t," << endl;
+    cout << "-R and -k apply)" << endl;
+    exit( 1 );
+}
+
+
+static bool parse_pattern( const char * name, pattern_t & pattern )
+{
+    static const char * const names[] = { "move", "line", "curve", "mixed" };
+
+    for( int i = 0; i < 4; ++i )
+    {
+        if( strcmp( name, names[i] ) == 0 )
+        {
+            pattern = (pattern_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Zig-zag across the square so consecutive points are always distinct */
+static xy point( int i, double area )
+{
+    static const int STEPS = 20;
+    int row = ( i / STEPS ) % STEPS;
+    int col = i % STEPS;
+
+    if( row & 1 )
+    {
+        col = STEPS - 1 - col;
+    }
+    return xy( area * col / STEPS, area * row / STEPS );
+}
+
+
+static bool send_one( Device::C & cutter, pattern_t pattern, int i, double area )
+{
+    xy pt = point( i, area );
+
+    if( pattern == PATTERN_MIXED )
+    {
+        pattern = (pattern_t)( i % 3 );
+    }
+    switch( pattern )
+    {
+        case PATTERN_LINE:
+            return cutter.cut_to( pt );
+
+        case PATTERN_CURVE:
+        {
+            xy from = point( i > 0 ? i - 1 : 0, area );
+            xy c1( from.x + ( pt.x - from.x ) / 3, from.y + area / 20 );
+            xy c2( from.x + 2 * ( pt.x - from.x ) / 3, pt.y - area / 20 );
+            return cutter.curve_to( from, c1, c2, pt );
+        }
+
+        default:
+            return cutter.move_to( pt );
+    }
+}
+
+
+#if( __linux )
+struct port_tally
+{
+    int acked;
+    int timeouts;
+    int errors;
+};
+
+
+static void tally_frame( int port, transport::read_status_t status, void * closure )
+{
+    port_tally * t = (port_tally *)closure;
+
+    switch( status )
+    {
+        case transport::READ_OK:      t->acked++;    break;
+        case transport::READ_TIMEOUT: t->timeouts++; break;
+        default:                      t->errors++;   break;
+    }
+}
+
+
+/* The same stream to every port at once, all from this thread */
+static int run_ports( char ** devices, int ports, pattern_t pattern, int count, double area,
+    int window, int timeout, int rate, bool keyvalue )
+{
+    Device::C encoder;
+    ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
+    encoder.set_move_key(move_key);
+    ckey_type line_key={LINE_KEY_0, LINE_KEY_1, LINE_KEY_2, LINE_KEY_3 };
+    encoder.set_line_key(line_key);
+    ckey_type curve_key={CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 };
+    encoder.set_curve_key(curve_key);
+
+    std::vector<lmc_command> frames;
+    for( int i = 0; i < count; ++i )
+    {
+        pattern_t kind = pattern == PATTERN_MIXED ? (pattern_t)( i % 3 ) : pattern;
+        xy pt = point( i, area );
+        lmc_command l;
+
+        if( kind == PATTERN_CURVE )
+        {
+            xy from = point( i > 0 ? i - 1 : 0, area );
+            xy pts[4] = { from,
+                xy( from.x + ( pt.x - from.x ) / 3, from.y + area / 20 ),
+                xy( from.x + 2 * ( pt.x - from.x ) / 3, pt.y - area / 20 ),
+                pt };
+            for( int j = 0; j < 4; ++j )
+            {
+                encoder.encode_frame( pts[j], Device::CMD_CURVE, l );
+                frames.push_back( l );
+            }
+        }
+        else
+        {
+            encoder.encode_frame( pt, kind == PATTERN_LINE ? Device::CMD_CUT : Device::CMD_MOVE, l );
+            frames.push_back( l );
+        }
+    }
+
+    port_loop loop;
+    std::vector<serial_port *> serial( ports );
+    std::vector<port_tally> tally( ports );
+    for( int i = 0; i < ports; ++i )
+    {
+        serial[i] = new serial_port( devices[i], rate );
+        tally[i].acked = tally[i].timeouts = tally[i].errors = 0;
+
+        int id = loop.add_port( serial[i], window, timeout );
+        if( id != i )
+        {
+            cout << devices[i] << ": port not open" << endl;
+            return 2;
+        }
+        loop.queue_start( id );
+        for( std::size_t f = 0; f < frames.size(); ++f )
+        {
+            loop.queue_frame( id, frames[f], tally_frame, &tally[i] );
+        }
+        loop.queue_stop( id );
+    }
+
+    uint64_t begin = stats_clock();
+    loop.run();
+    double secs = ( stats_clock() - begin ) / 1e9;
+
+    int total = 0;
+    bool clean = true;
+    for( int i = 0; i < ports; ++i )
+    {
+        if( keyvalue )
+        {
+            printf( "port=%s acked=%d timeouts=%d errors=%d\n",
+                devices[i], tally[i].acked, tally[i].timeouts, tally[i].errors );
+        }
+        else
+        {
+            printf( "%s: %d of %d frames acked, %d timed out, %d failed\n",
+                devices[i], tally[i].acked, (int)frames.size(), tally[i].timeouts, tally[i].errors );
+        }
+        total += tally[i].acked;
+        clean  = clean && tally[i].acked == (int)frames.size();
+        loop.remove_port( i );
+        delete serial[i];
+    }
+    if( keyvalue )
+    {
+        printf( "ports=%d\nframes=%d\nseconds=%.6f\nframes_per_sec=%.1f\n", ports, total, secs, total / secs );
+    }
+    else
+    {
+        printf( "%d ports, %d frames acked in %.3f s, %.1f frames/s\n", ports, total, secs, total / secs );
+    }
+    return clean ? 0 : 5;
+}
+#endif
+
+
+int main( int argc, char * argv[] )
+{
+    int       count    = 1000;
+    pattern_t pattern  = PATTERN_MOVE;
+    double    area     = 1;
+    int       window   = 1;
+    int       coalesce = 1;
+    int       timeout  = 1000;
+    int       retries  = 0;
+    int       rate     = 0;
+    bool      per_byte = false;
+    bool      threaded = false;
+    bool      keyvalue = false;
+    int       opt;
+
+    while( ( opt = getopt( argc, argv, "n:p:a:w:c:t:r:R:bTk" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'n': count    = atoi( optarg ); break;
+            case 'a': area     = atof( optarg ); break;
+            case 'w': window   = atoi( optarg ); break;
+            case 'c': coalesce = atoi( optarg ); break;
+            case 't': timeout  = atoi( optarg ); break;
+            case 'r': retries  = atoi( optarg ); break;
+            case 'R': rate     = atoi( optarg ); break;
+            case 'b': per_byte = true;           break;
+            case 'T': threaded = true;           break;
+            case 'k': keyvalue = true;           break;
+            case 'p':
+                if( !parse_pattern( optarg, pattern ) )
+                {
+                    usage( argv[0] );
+                }
+                break;
+            default:
+                usage( argv[0] );
+        }
+    }
+    if( argc - optind < 1 )
+    {
+        usage( argv[0] );
+    }
+    if( argc - optind > 1 )
+    {
+        #if( __linux )
+        return run_ports( argv + optind, argc - optind, pattern, count, area, window, timeout, rate, keyvalue );
+        #else
+        cout << "several devices need port_loop, which is Linux only" << endl;
+        return 1;
+        #endif
+    }
+
+    const std::string device = argv[ optind ];
+    loopback_transport loopback;
+    Device::C cutter;
+
+    if( device == "loopback" )
+    {
+        cutter.set_transport( &loopback );
+    }
+    else
+    {
+        cutter.init( device );
+        if( !cutter.is_open() )
+        {
+            cout << "Port not open" << endl;
+            return 2;
+        }
+        if( rate > 0 && !cutter.set_link_rate( rate ) )
+        {
+            cout << "driver refused " << rate << " bits/s, pacing for it anyway" << endl;
+        }
+    }
+
+    ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
+    cutter.set_move_key(move_key);
+    ckey_type line_key={LINE_KEY_0, LINE_KEY_1, LINE_KEY_2, LINE_KEY_3 };
+    cutter.set_line_key(line_key);
+    ckey_type curve_key={CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 };
+    cutter.set_curve_key(curve_key);
+
+    cutter.set_window( window );
+    cutter.set_max_coalesce( coalesce );
+    cutter.set_ack_timeout( timeout );
+    cutter.set_ack_retries( retries );
+    cutter.set_tx_mode( per_byte ? serial_port::TX_PER_BYTE : serial_port::TX_FRAME );
+    if( threaded && !cutter.start_io_thread() )
+    {
+        return 3;
+    }
+
+    if( !cutter.start() )
+    {
+        cout << "start failed" << endl;
+        return 4;
+    }
+    cutter.reset_stats();
+    cutter.enable_stats( true );
+
+    int      failed = 0;
+    uint64_t begin  = stats_clock();
+    for( int i = 0; i < count; ++i )
+    {
+        if( !send_one( cutter, pattern, i, area ) )
+        {
+            failed++;
+        }
+    }
+    if( !cutter.wait_idle() )
+    {
+        failed++;
+    }
+    double secs = ( stats_clock() - begin ) / 1e9;
+
+    /* Summaries are taken before stop(), whose own frame is not part of
+       the stream */
+    latency_histogram ack;
+    uint64_t commands = 0;
+    uint64_t frames   = 0;
+    uint64_t bytes    = 0;
+    uint64_t timeouts = 0;
+    uint64_t unacked  = cutter.unacked_commands();
+
+    ack.reset();
+    for( int t = STAT_MOVE; t <= STAT_CURVE; ++t )
+    {
+        const command_stats & s = cutter.get_stats( (stat_type)t );
+
+        frames   += s.count;
+        bytes    += s.bytes;
+        timeouts += s.timeouts;
+        ack.merge( s.ack );
+    }
+    commands = count;
+
+    cutter.dump_stats( cout );
+    cutter.enable_stats( false );
+    cutter.stop();
+    cutter.stop_io_thread();
+
+    if( keyvalue )
+    {
+        printf( "commands=%llu\nframes=%llu\nbytes=%llu\nseconds=%.6f\n",
+            (unsigned long long)commands, (unsigned long long)frames,
+            (unsigned long long)bytes, secs );
+        printf( "commands_per_sec=%.1f\nbytes_per_sec=%.1f\n",
+            commands / secs, bytes / secs );
+        printf( "ack_min_us=%.1f\nack_mean_us=%.1f\n", ack.min / 1000.0, ack.mean() / 1000.0 );
+        printf( "ack_p50_us=%.1f\nack_p90_us=%.1f\nack_p99_us=%.1f\nack_max_us=%.1f\n",
+            ack.percentile( 50 ) / 1000.0, ack.percentile( 90 ) / 1000.0,
+            ack.percentile( 99 ) / 1000.0, ack.max / 1000.0 );
+        printf( "timeouts=%llu\nunacked=%llu\nfailed=%d\n",
+            (unsigned long long)timeouts, (unsigned long long)unacked, failed );
+    }
+    else
+    {
+        printf( "%llu commands (%llu frames, %llu bytes) in %.3f s\n",
+            (unsigned long long)commands, (unsigned long long)frames,
+            (unsigned long long)bytes, secs );
+        printf( "%.1f commands/s, %.1f bytes/s\n", commands / secs, bytes / secs );
+        printf( "ack latency min %.1f mean %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f us\n",
+            ack.min / 1000.0, ack.mean() / 1000.0,
+            ack.percentile( 50 ) / 1000.0, ack.percentile( 90 ) / 1000.0,
+            ack.percentile( 99 ) / 1000.0, ack.max / 1000.0 );
+        printf( "%llu timeouts, %llu commands unacked, %d failed calls\n",
+            (unsigned long long)timeouts, (unsigned long long)unacked, failed );
+    }
+    return failed == 0 && timeouts == 0 && unacked == 0 ? 0 : 5;
+}
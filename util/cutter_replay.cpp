@@ -0,0 +1,136 @@
+/*
+ * cutter_replay - Re-send a captured serial session
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+#include "serial_port.hpp"
+#include "capture.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+using std::cout;
+using std::endl;
+
+static void usage( const char * progname )
+{
+    cout << "usage: " << progname << " [-f] [-t ack_timeout_ms] capture device" << endl;
+    cout << "  -f  send as fast as the link allows instead of with the captured timing" << endl;
+    exit( 1 );
+}
+
+
+int main( int argc, char * argv[] )
+{
+    bool fast    = false;
+    int  timeout = 1000;
+    int  opt;
+
+    while( ( opt = getopt( argc, argv, "ft:" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'f':
+                fast = true;
+                break;
+            case 't':
+                timeout = atoi( optarg );
+                break;
+            default:
+                usage( argv[0] );
+        }
+    }
+    if( argc - optind != 2 )
+    {
+        usage( argv[0] );
+    }
+
+    capture_reader reader;
+    if( !reader.open( argv[ optind ] ) )
+    {
+        cout << "Could not read capture " << argv[ optind ] << endl;
+        return 2;
+    }
+
+    serial_port port( argv[ optind + 1 ] );
+    if( !port.is_open() )
+    {
+        cout << "Port not open" << endl;
+        return 3;
+    }
+
+    capture_record rec;
+    uint64_t records  = 0;
+    uint64_t sent     = 0;
+    uint64_t expected = 0;
+    uint64_t received = 0;
+    uint64_t differ   = 0;
+    uint64_t original = 0;
+    uint64_t start    = port.getTime();
+
+    while( reader.next( rec ) )
+    {
+        records++;
+        original = rec.time;
+        if( rec.dir == CAPTURE_TX )
+        {
+            if( !fast )
+            {
+                port.pace_until( start + rec.time );
+            }
+            sent += port.p_write( &rec.data[0], rec.data.size() );
+        }
+        else
+        {
+            std::vector<uint8_t> buf( rec.data.size() );
+            size_t got;
+
+            /* Keep in step with the device: wait for as many bytes as it
+               sent back last time before sending anything else */
+            port.p_read_timed( &buf[0], buf.size(), timeout, got );
+            expected += rec.data.size();
+            received += got;
+            if( got != buf.size() )
+            {
+                port.flush_input();
+            }
+            if( memcmp( &buf[0], &rec.data[0], got ) != 0 )
+            {
+                differ++;
+            }
+        }
+    }
+
+    uint64_t elapsed = port.getTime() - start;
+    printf( "%llu records, %llu bytes sent, %llu of %llu bytes received, %llu replies differed\n",
+        (unsigned long long)records, (unsigned long long)sent,
+        (unsigned long long)received, (unsigned long long)expected,
+        (unsigned long long)differ );
+    printf( "captured session took %.3f s, replay took %.3f s\n",
+        original / 1000000.0, elapsed / 1000000.0 );
+
+    return received == expected ? 0 : 4;
+}
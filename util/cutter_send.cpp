@@ -0,0 +1,177 @@
+/*
+ * cutter_send - stream a compiled .cutbin job to a cutter
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+/*
+ * Sends a job that draw_gcode, draw_svg or interpreter compiled into a
+ * .cutbin file. The file is mapped rather than read, and its frames go
+ * to the port as they are: nothing is parsed or encrypted here, so the
+ * machine driving the cutter only does I/O.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "device_c.hpp"
+#include "cutbin.hpp"
+#include "keys.h"
+
+using std::cout;
+using std::endl;
+
+static void usage( const char * progname )
+{
+    cout << "usage: " << progname << " [-w window] [-f] device job.cutbin" << endl;
+    cout << "       " << progname << " -i job.cutbin" << endl;
+    cout << "  -w  commands in flight at once (default 1)" << endl;
+    cout << "  -f  send even if the job was compiled with other keys" << endl;
+    cout << "  -i  only print the header" << endl;
+    exit( 1 );
+}
+
+
+static void print_header( const Device::cutbin_header & header )
+{
+    char line[ 256 ];
+
+    snprintf( line, sizeof( line ),
+        "%s, %u units/in: %u commands, %u frames, box %d,%d to %d,%d, about %.1f s at %u bits/s\n"
+        "source %016llx, keys %016llx %016llx %016llx",
+        header.profile, header.units_per_inch, header.commands, header.frames,
+        header.min.x, header.min.y, header.max.x, header.max.y,
+        header.estimated_ms / 1000.0, header.link_rate,
+        (unsigned long long)header.source_hash, (unsigned long long)header.key_ids[0],
+        (unsigned long long)header.key_ids[1], (unsigned long long)header.key_ids[2] );
+    cout << line << endl;
+}
+
+
+int main( int argc, char * argv[] )
+{
+    int  window = 1;
+    bool force  = false;
+    bool info   = false;
+    int  opt;
+
+    while( ( opt = getopt( argc, argv, "w:fi" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'w': window = atoi( optarg ); break;
+            case 'f': force  = true;           break;
+            case 'i': info   = true;           break;
+            default:
+                usage( argv[0] );
+        }
+    }
+    if( argc - optind != ( info ? 1 : 2 ) )
+    {
+        usage( argv[0] );
+    }
+    const char * file = argv[ argc - 1 ];
+
+    int fd = open( file, O_RDONLY );
+    struct stat st;
+    if( fd < 0 || fstat( fd, &st ) != 0 )
+    {
+        perror( file );
+        return 2;
+    }
+    void * map = st.st_size > 0 ? mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+    close( fd );
+
+    Device::cutbin_header header;
+    if( map == MAP_FAILED || !Device::parse_cutbin( (const uint8_t*)map, st.st_size, header ) )
+    {
+        cout << file << ": not a .cutbin job" << endl;
+        return 2;
+    }
+    print_header( header );
+    if( info )
+    {
+        return 0;
+    }
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+
+    Device::C cutter( argv[ optind ] );
+    if( !cutter.is_open() )
+    {
+        cout << "Port not open" << endl;
+        return 3;
+    }
+    ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
+    cutter.set_move_key(move_key);
+    ckey_type line_key={LINE_KEY_0, LINE_KEY_1, LINE_KEY_2, LINE_KEY_3 };
+    cutter.set_line_key(line_key);
+    ckey_type curve_key={CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 };
+    cutter.set_curve_key(curve_key);
+
+    if( header.key_ids[0] != cutter.key_id( STAT_MOVE ) ||
+        header.key_ids[1] != cutter.key_id( STAT_LINE ) ||
+        header.key_ids[2] != cutter.key_id( STAT_CURVE ) )
+    {
+        cout << file << ": compiled with other keys than this build has" << endl;
+        if( !force )
+        {
+            return 4;
+        }
+    }
+    cutter.set_window( window );
+
+    const lmc_command * frames = (const lmc_command *)( (const uint8_t*)map + Device::CUTBIN_HEADER_SIZE );
+    const uint8_t * tags = (const uint8_t*)( frames + header.frames );
+    stat_type types[ 256 ];
+    std::size_t sent = 0;
+    uint64_t begin = stats_clock();
+
+    cutter.stop();
+    cutter.start();
+    while( sent < header.frames )
+    {
+        std::size_t n = header.frames - sent < 256 ? header.frames - sent : 256;
+        for( std::size_t i = 0; i < n; ++i )
+        {
+            types[i] = (stat_type)tags[ sent + i ];
+        }
+        std::size_t done = cutter.send_frames( frames + sent, types, n );
+        sent += done;
+        if( done < n )
+        {
+            break;
+        }
+    }
+    bool ok = cutter.stop() && sent == header.frames;
+    double secs = ( stats_clock() - begin ) / 1e9;
+
+    printf( "sent %llu of %u frames in %.2f s (estimate %.1f s)\n",
+        (unsigned long long)sent, header.frames, secs, header.estimated_ms / 1000.0 );
+    munmap( map, st.st_size );
+    return ok ? 0 : 5;
+}
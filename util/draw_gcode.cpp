@@ -7,6 +7,9 @@
 #include <cstdlib>
 #include <cstring>
 #include "device_c.hpp"
+#include "device_filter.hpp"
+#include "device_recorder.hpp"
+#include "cutbin.hpp"
 #include "keys.h"
 
 using namespace std;
@@ -15,7 +18,7 @@ using namespace std;
 
 void usage(char *progname)
 {
-     printf("Usage: %s [-d debug_level] <device file> <gcode file>\n",
+     printf("Usage: %s [-d debug_level] <device file|out.cutbin> <gcode file>\n",
 	    progname);
      printf("%s\n", debug_msg.c_str());
      exit(1);
@@ -41,12 +44,25 @@ int main( int num_args, char * args[] )
      else
 	  usage(args[0]);
 
-     Device::C cutter( args[arg_start++] );
-     gcode parser( args[arg_start++], cutter );
+     //Given a .cutbin instead of a device, compile the job into it
+     const char * output = args[arg_start++];
+     const char * source = args[arg_start++];
+     bool compile = Device::is_cutbin( output );
+     Device::C cutter;
+     if( !compile )
+     {
+	  cutter.init( output );
+     }
+     Device::Recorder recorder( cutter.get_dimensions() );
+     Device::Filter filter( compile ? (Device::Generic&)recorder : (Device::Generic&)cutter );
+     gcode parser( source, filter );
      gcode_base::set_debug(d);
 
-     cutter.stop();
-     cutter.start();
+     if( !compile )
+     {
+	  cutter.stop();
+     }
+     filter.start();
 
      ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
      cutter.set_move_key(move_key);
@@ -66,7 +82,12 @@ int main( int num_args, char * args[] )
 	  printf("Unhandled exception");
      }
 
-     cutter.stop();
+     filter.stop();
+     filter.dump_stats( std::cout );
+     if( compile && !Device::compile_cutbin( output, cutter, recorder, Device::hash_file( source ) ) )
+     {
+	  return 3;
+     }
 
      return 0;
 }
@@ -1,10 +1,16 @@
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <vector>
 #include <cmath>
 #include <svg.h>
 #include <unistd.h>
 
 #include "device_c.hpp"
+#include "device_filter.hpp"
+#include "device_recorder.hpp"
+#include "cutbin.hpp"
+#include "job_cache.hpp"
 
 #include "keys.h"
 
@@ -734,22 +740,82 @@ static svg_status_t render_image_callback( void * ptr, unsigned char * data, uns
 }
 
 
+static void usage( const char * progname )
+{
+    cout<<"Usage: "<<progname<<" [-c cachedir] svgfile.svg iodevice|out.cutbin"<<endl;
+    cout<<"  -c  encode the whole drawing first and keep it in cachedir,"<<endl;
+    cout<<"      so sending it again skips the encryption"<<endl;
+    exit( 4 );
+}
+
+
+/* Send the recorded drawing as one job through a job cache kept in dir,
+   so a drawing sent before goes out without encrypting anything */
+static bool send_cached( Device::C & c, const Device::Recorder & recorder, const char * dir )
+{
+    const vector<Device::command> & cmds = recorder.get_commands();
+    vector<Device::unit_command> units( cmds.size() );
+
+    if( cmds.empty() )
+    {
+        return true;
+    }
+    for( size_t i = 0; i < cmds.size(); ++i )
+    {
+        units[i] = Device::C::to_units( cmds[i] );
+    }
+
+    Device::job_cache cache( 1, dir );
+    const Device::C::encoded_job * job = cache.get( c, &units[0], units.size() );
+    if( job == NULL )
+    {
+        cout << "could not encode the drawing" << endl;
+        return false;
+    }
+    cache.dump_stats( cout );
+    return c.start() && c.send_job( *job ) == units.size();
+}
+
+
 int main(int numArgs, char * args[] )
 {
     svg_t * svg;
     svg_length_t width;
     svg_length_t height;
     svg_render_engine_t engine;
+    const char * cache_dir = NULL;
+    int opt;
 
-    if( numArgs != 3 )
+    while( ( opt = getopt( numArgs, args, "c:" ) ) != -1 )
     {
-        cout<<"Usage: "<<args[0]<<" svgfile.svg iodevice"<<endl;
-        return 4;
+        switch( opt )
+        {
+            case 'c': cache_dir = optarg; break;
+            default:  usage( args[0] );   break;
+        }
     }
-
-    Device::C c( args[2] );
-    c.stop();
-    c.start();
+    if( numArgs - optind != 2 )
+    {
+        usage( args[0] );
+    }
+    const char * svg_file = args[optind];
+    const char * output   = args[optind + 1];
+
+    //Given a .cutbin instead of a device, compile the job into it
+    bool compile = Device::is_cutbin( output );
+    bool cached  = !compile && cache_dir != NULL;
+    Device::C c;
+    if( !compile )
+    {
+        c.init( output );
+    }
+    Device::Recorder recorder( c.get_dimensions() );
+    Device::Filter filter( compile || cached ? (Device::Generic&)recorder : (Device::Generic&)c );
+    if( !compile )
+    {
+        c.stop();
+    }
+    filter.start();
 
     ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
     c.set_move_key(move_key);
@@ -761,7 +827,7 @@ int main(int numArgs, char * args[] )
     c.set_curve_key(curve_key);
 
 
-    svg_render_state_t state(c);
+    svg_render_state_t state(filter);
 
     //For debugging
     memset( (void*)&engine, 0xAD, sizeof( engine ) );
@@ -806,7 +872,7 @@ int main(int numArgs, char * args[] )
     engine.close_path             = close_path_callback;
 
     svg_create( &svg );
-    svg_parse( svg, args[1] );
+    svg_parse( svg, svg_file );
 
     svg_get_size( svg, &width, &height );
     cout << "SVG: "<< width.value << "x" << height.value << endl;
@@ -815,6 +881,23 @@ int main(int numArgs, char * args[] )
 
     svg_destroy( svg );
 
-    sleep(1);
-    c.stop();
+    filter.flush();
+    if( cached && !send_cached( c, recorder, cache_dir ) )
+    {
+        return 3;
+    }
+    if( !compile )
+    {
+        sleep(1);
+    }
+    filter.stop();
+    if( cached )
+    {
+        c.stop();
+    }
+    filter.dump_stats( cout );
+    if( compile && !Device::compile_cutbin( output, c, recorder, Device::hash_file( svg_file ) ) )
+    {
+        return 3;
+    }
 }
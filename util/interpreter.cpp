@@ -7,12 +7,15 @@ using namespace std;
 
 #include "keys.h"
 #include "device_c.hpp"
+#include "device_filter.hpp"
+#include "device_recorder.hpp"
+#include "cutbin.hpp"
 
 int main( int numArgs, char * args[] )
 {
     if( numArgs != 3 )
     {
-        cout<<"Usage: "<<args[0]<<" /dev/serial/port filename"<<endl;
+        cout<<"Usage: "<<args[0]<<" /dev/serial/port|out.cutbin filename"<<endl;
         exit(1);
     }
 
@@ -23,25 +26,38 @@ int main( int numArgs, char * args[] )
         exit(2);
     }
 
-    Device::C c(args[1]);
+    //Given a .cutbin instead of a port, compile the job into it
+    bool compile = Device::is_cutbin( args[1] );
+    Device::C c;
+    if( !compile )
+    {
+        c.init( args[1] );
+    }
     ckey_type move_key={MOVE_KEY_0, MOVE_KEY_1, MOVE_KEY_2, MOVE_KEY_3 };
     c.set_move_key(move_key);
 
     ckey_type line_key={LINE_KEY_0, LINE_KEY_1, LINE_KEY_2, LINE_KEY_3 };
     c.set_line_key(line_key);
 
-    c.stop();
-    c.start();
+    ckey_type curve_key={CURVE_KEY_0, CURVE_KEY_1, CURVE_KEY_2, CURVE_KEY_3 };
+    c.set_curve_key(curve_key);
+
+    Device::Recorder recorder( c.get_dimensions() );
+    Device::Filter filter( compile ? (Device::Generic&)recorder : (Device::Generic&)c );
+    char  command;
 
-    while( inputfile )
+    if( !compile )
+    {
+        c.stop();
+    }
+    filter.start();
+
+    while( inputfile >> command )
     {
-        char  command;
         xy    point;
         float stime;
         xy    curve_pts[4];
 
-        inputfile >> command;
-
         switch( command )
         {
             case 'm':
@@ -49,7 +65,7 @@ int main( int numArgs, char * args[] )
                 inputfile >> point.x;
                 inputfile >> point.y;
                 cout << "Moving to " << point.x << ',' << point.y << endl;
-                c.move_to( point );
+                filter.move_to( point );
                 break;
 
             case 'c':
@@ -57,7 +73,7 @@ int main( int numArgs, char * args[] )
                 inputfile >> point.x;
                 inputfile >> point.y;
                 cout << "Cutting to " << point.x << ',' << point.y << endl;
-                c.cut_to( point );
+                filter.cut_to( point );
                 break;
 
             case 'b':
@@ -75,13 +91,17 @@ int main( int numArgs, char * args[] )
                     << curve_pts[1].x << ',' << curve_pts[1].y << '\t'
                     << curve_pts[2].x << ',' << curve_pts[2].y << '\t'
                     << curve_pts[3].x << ',' << curve_pts[3].y << endl;
-                c.curve_to( curve_pts[0], curve_pts[1], curve_pts[2], curve_pts[3] );
+                filter.curve_to( curve_pts[0], curve_pts[1], curve_pts[2], curve_pts[3] );
                 break;
 
             case 's':
             case 'S':
                 inputfile >> stime;
-                sleep( stime );
+                filter.flush();
+                if( !compile )
+                {
+                    sleep( stime );
+                }
                 break;
 
             default:
@@ -89,6 +109,11 @@ int main( int numArgs, char * args[] )
                 break;
         }
     }
-    c.stop();
+    filter.stop();
+    filter.dump_stats( cout );
+    if( compile && !Device::compile_cutbin( args[1], c, recorder, Device::hash_file( args[2] ) ) )
+    {
+        return 3;
+    }
     return 0;
 }
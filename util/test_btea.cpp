@@ -47,6 +47,60 @@ void print_hex( const uint8_t * ptr, int numBytes )
 }
 
 
+/* Batch over unaligned, strided payloads with varied keys and data,
+   compared against btea() one payload at a time */
+static int batch_mismatches( void )
+{
+    static const int COUNT  = 257;
+    static const int STRIDE = 14;
+    uint8_t  frames[ COUNT * STRIDE + 1 ];
+    uint32_t expect[ COUNT ][3];
+    uint32_t key[4];
+    uint32_t seed = 0x12345678;
+    int      failed = 0;
+
+    for( int round = 0; round < 16; ++round )
+    {
+        int count = COUNT - round;
+
+        for( int i = 0; i < 4; ++i )
+        {
+            seed = seed * 1103515245 + 12345;
+            key[i] = seed;
+        }
+        for( int i = 0; i < count; ++i )
+        {
+            for( int j = 0; j < 3; ++j )
+            {
+                seed = seed * 1103515245 + 12345;
+                expect[i][j] = seed;
+            }
+            memcpy( frames + 1 + i * STRIDE, expect[i], sizeof( expect[i] ) );
+            btea( expect[i], 3, key );
+        }
+        if( round & 1 )
+        {
+            btea3_schedule ks;
+
+            btea3_schedule_init( &ks, key );
+            btea3_encrypt_batch_scheduled( frames + 1, count, STRIDE, &ks );
+        }
+        else
+        {
+            btea3_encrypt_batch( frames + 1, count, STRIDE, key );
+        }
+        for( int i = 0; i < count; ++i )
+        {
+            if( memcmp( frames + 1 + i * STRIDE, expect[i], sizeof( expect[i] ) ) != 0 )
+            {
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+
 int main( int numArgs, char *args[] )
 {
     const char * ptr;
@@ -114,4 +168,65 @@ int main( int numArgs, char *args[] )
     }
 
     free( buffer );
+
+    //The n = 3 kernel has to agree with the generic one bit for bit
+    uint32_t fixed[3];
+    memset( fixed, 0x00, sizeof( fixed ) );
+    memcpy( fixed, "TestPhrase!", strlen( "TestPhrase!" ) );
+    btea3_encrypt( fixed, keys );
+    uint32_t scheduled[3];
+    btea3_schedule ks;
+    memset( scheduled, 0x00, sizeof( scheduled ) );
+    memcpy( scheduled, "TestPhrase!", strlen( "TestPhrase!" ) );
+    btea3_schedule_init( &ks, keys );
+    btea3_encrypt_scheduled( scheduled, &ks );
+    if( memcmp( known_result, fixed, sizeof( known_result ) ) == 0 &&
+        memcmp( known_result, scheduled, sizeof( known_result ) ) == 0 )
+    {
+        cout << "Hurray, you passed the btea3 known result test" << endl;
+    }
+    else
+    {
+        cout << "You failed the btea3 known result test" << endl;
+        return 1;
+    }
+
+    /* Every batch kernel the CPU has must give the known result in each
+       lane, and agree with btea() on varied keys, data and tail lengths */
+    for( int impl = 0; impl < BTEA3_NUM_IMPLS; ++impl )
+    {
+        const char * name = btea3_impl_name( (btea3_impl)impl );
+
+        if( !btea3_set_impl( (btea3_impl)impl ) )
+        {
+            cout << "Skipping the " << name << " btea3 kernel, this CPU lacks it" << endl;
+            continue;
+        }
+
+        uint32_t copies[13][3];
+        bool     known = true;
+        for( int i = 0; i < 13; ++i )
+        {
+            memset( copies[i], 0x00, sizeof( copies[i] ) );
+            memcpy( copies[i], "TestPhrase!", strlen( "TestPhrase!" ) );
+        }
+        btea3_encrypt_batch( copies, 13, 0, keys );
+        for( int i = 0; i < 13; ++i )
+        {
+            known = known && memcmp( known_result, copies[i], sizeof( known_result ) ) == 0;
+        }
+
+        int failed = batch_mismatches();
+        if( known && failed == 0 )
+        {
+            cout << "Hurray, you passed the " << name << " btea3 batch test" << endl;
+        }
+        else
+        {
+            cout << "You failed the " << name << " btea3 batch test" << ( known ? "" : " on the known result" )
+                 << " with " << failed << " bad payloads" << endl;
+            return 1;
+        }
+    }
+    return 0;
 }
@@ -0,0 +1,163 @@
+/*
+ * test_cutbin - compile a job to a .cutbin and parse it back
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include "device_c.hpp"
+#include "device_recorder.hpp"
+#include "cutbin.hpp"
+
+using std::cout;
+using std::endl;
+
+static const char * CUTBIN_FILE = "test_cutbin.cutbin";
+
+static int failed = 0;
+
+static void check( bool ok, const char * what )
+{
+    if( !ok )
+    {
+        cout << "FAILED: " << what << endl;
+        failed++;
+    }
+}
+
+static std::vector<uint8_t> read_file( const char * file )
+{
+    std::vector<uint8_t> data;
+    FILE * in = fopen( file, "rb" );
+    int c;
+
+    while( in != NULL && ( c = fgetc( in ) ) != EOF )
+    {
+        data.push_back( c );
+    }
+    if( in != NULL )
+    {
+        fclose( in );
+    }
+    return data;
+}
+
+/* parse_cutbin() must refuse good with one change made to it */
+static void check_rejects( const std::vector<uint8_t> & good, std::size_t at, int value, std::size_t size, const char * what )
+{
+    std::vector<uint8_t> bad( good );
+    Device::cutbin_header header;
+
+    if( at < bad.size() )
+    {
+        bad[ at ] = value;
+    }
+    bad.resize( size, 0 );
+    check( !Device::parse_cutbin( bad.empty() ? NULL : &bad[0], bad.size(), header ), what );
+}
+
+
+int main( int numArgs, char *args[] )
+{
+    ckey_type move_key  = { 0x01234567, 0x89abcdef, 0x02468ace, 0x13579bdf };
+    ckey_type line_key  = { 0x11111111, 0x22222222, 0x33333333, 0x44444444 };
+    ckey_type curve_key = { 0x55555555, 0x66666666, 0x77777777, 0x88888888 };
+    Device::C c;
+
+    c.set_move_key( move_key );
+    c.set_line_key( line_key );
+    c.set_curve_key( curve_key );
+
+    check( Device::is_cutbin( "job.cutbin" ) && !Device::is_cutbin( ".cutbin" ) &&
+        !Device::is_cutbin( "/dev/ttyUSB0" ), "is_cutbin" );
+
+    //A square with a curved corner, on the device's grid
+    Device::Recorder recorder( c.get_dimensions() );
+    recorder.move_to( xy( 1, 1 ) );
+    recorder.cut_to( xy( 3, 1 ) );
+    recorder.cut_to( xy( 3, 3 ) );
+    recorder.curve_to( xy( 3, 3 ), xy( 2.5, 3.5 ), xy( 1.5, 3.5 ), xy( 1, 3 ) );
+    recorder.cut_to( xy( 1, 1 ) );
+
+    const std::vector<Device::command> & cmds = recorder.get_commands();
+    std::vector<Device::unit_command> units( cmds.size() );
+    for( std::size_t i = 0; i < cmds.size(); ++i )
+    {
+        units[i] = Device::C::to_units( cmds[i] );
+    }
+    Device::C::encoded_job job;
+    check( c.encode_job( &units[0], units.size(), job ) == units.size(), "encode_job" );
+
+    //What compile_cutbin() writes has to parse back to the same job
+    check( Device::compile_cutbin( CUTBIN_FILE, c, recorder, 0x1234567890abcdefULL ), "compile_cutbin" );
+    std::vector<uint8_t> good = read_file( CUTBIN_FILE );
+    remove( CUTBIN_FILE );
+
+    Device::cutbin_header header;
+    check( !good.empty() && Device::parse_cutbin( &good[0], good.size(), header ), "parse_cutbin" );
+    check( strcmp( header.profile, "Device C" ) == 0, "profile" );
+    check( header.units_per_inch == (uint32_t)Device::C::UNITS_PER_INCH, "units per inch" );
+    check( header.key_ids[0] == c.key_id( STAT_MOVE ) && header.key_ids[1] == c.key_id( STAT_LINE ) &&
+        header.key_ids[2] == c.key_id( STAT_CURVE ), "key ids" );
+    check( header.source_hash == 0x1234567890abcdefULL, "source hash" );
+    check( header.commands == cmds.size() && header.frames == job.frames.size(), "counts" );
+    check( header.min.x == 0 && header.min.y == 0 &&
+        header.max.x == 3 * Device::C::UNITS_PER_INCH && header.max.y == 3.5 * Device::C::UNITS_PER_INCH, "bounding box" );
+    check( header.estimated_ms > 0, "estimated time" );
+
+    std::size_t frames = job.frames.size();
+    std::size_t types  = Device::CUTBIN_HEADER_SIZE + frames * sizeof( lmc_command );
+    check( good.size() == types + frames, "file size" );
+    if( good.size() == types + frames )
+    {
+        check( memcmp( &good[ Device::CUTBIN_HEADER_SIZE ], &job.frames[0], frames * sizeof( lmc_command ) ) == 0, "frames" );
+        for( std::size_t i = 0; i < frames; ++i )
+        {
+            check( good[ types + i ] == job.types[i], "frame types" );
+        }
+    }
+
+    //Anything else is refused
+    check_rejects( good, good.size(), 0, good.size() - 1, "truncated frame types" );
+    check_rejects( good, good.size(), 0, types, "missing frame types" );
+    check_rejects( good, good.size(), 0, Device::CUTBIN_HEADER_SIZE - 1, "truncated header" );
+    check_rejects( good, good.size(), 0, 0, "empty file" );
+    check_rejects( good, good.size(), 0, good.size() + 1, "trailing bytes" );
+    check_rejects( good, 0, 'X', good.size(), "bad magic" );
+    check_rejects( good, 4, 2, good.size(), "bad version" );
+    check_rejects( good, 8, 0, good.size(), "bad header size" );
+    check_rejects( good, 92, frames + 1, good.size(), "bad frame count" );
+    check_rejects( good, types, STAT_START, good.size(), "bad first frame type" );
+    check_rejects( good, good.size() - 1, 0xFF, good.size(), "bad last frame type" );
+
+    if( failed > 0 )
+    {
+        cout << failed << " cutbin checks failed" << endl;
+        return 1;
+    }
+    cout << "Hurray, you passed the cutbin tests" << endl;
+    return 0;
+}
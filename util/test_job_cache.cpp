@@ -0,0 +1,190 @@
+/*
+ * test_job_cache - save_job/load_job and job_cache round trips
+ * Copyright (c) 2010 - libcutter Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact us, the author, you can do so either at
+ * http://github.com/vangdfang/libcutter, or by paper mail:
+ *
+ * libcutter Developers @ Cowtown Computer Congress
+ * 3101 Mercier Street #404, Kansas City, MO 64111
+ */
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include "device_c.hpp"
+#include "job_cache.hpp"
+
+using std::cout;
+using std::endl;
+
+static const char * JOB_FILE = "test_job_cache.job";
+static const char * JOB_DIR  = ".";
+
+static int failed = 0;
+
+static void check( bool ok, const char * what )
+{
+    if( !ok )
+    {
+        cout << "FAILED: " << what << endl;
+        failed++;
+    }
+}
+
+static bool same_job( const Device::C::encoded_job & a, const Device::C::encoded_job & b )
+{
+    if( a.frames.size() != b.frames.size() || a.types != b.types || a.ends != b.ends ||
+        a.positions.size() != b.positions.size() )
+    {
+        return false;
+    }
+    for( std::size_t i = 0; i < a.positions.size(); ++i )
+    {
+        if( a.positions[i].x != b.positions[i].x || a.positions[i].y != b.positions[i].y )
+        {
+            return false;
+        }
+    }
+    return a.frames.empty() || memcmp( &a.frames[0], &b.frames[0], a.frames.size() * sizeof( lmc_command ) ) == 0;
+}
+
+static std::vector<uint8_t> read_file( const char * file )
+{
+    std::vector<uint8_t> data;
+    FILE * in = fopen( file, "rb" );
+    int c;
+
+    while( in != NULL && ( c = fgetc( in ) ) != EOF )
+    {
+        data.push_back( c );
+    }
+    if( in != NULL )
+    {
+        fclose( in );
+    }
+    return data;
+}
+
+static void write_file( const char * file, const std::vector<uint8_t> & data )
+{
+    FILE * out = fopen( file, "wb" );
+
+    if( out != NULL )
+    {
+        if( !data.empty() )
+        {
+            fwrite( &data[0], 1, data.size(), out );
+        }
+        fclose( out );
+    }
+}
+
+/* Write good with one change made to it and see load_job() refuse it */
+static void check_rejects( const std::vector<uint8_t> & good, std::size_t at, int value, std::size_t size, const char * what )
+{
+    std::vector<uint8_t> bad( good );
+    Device::C::encoded_job job;
+    uint64_t hash;
+
+    if( at < bad.size() )
+    {
+        bad[ at ] = value;
+    }
+    bad.resize( size, 0 );
+    write_file( JOB_FILE, bad );
+    check( !Device::load_job( JOB_FILE, job, hash ), what );
+}
+
+
+int main( int numArgs, char *args[] )
+{
+    ckey_type move_key  = { 0x01234567, 0x89abcdef, 0x02468ace, 0x13579bdf };
+    ckey_type line_key  = { 0x11111111, 0x22222222, 0x33333333, 0x44444444 };
+    ckey_type curve_key = { 0x55555555, 0x66666666, 0x77777777, 0x88888888 };
+    Device::C c;
+
+    c.set_move_key( move_key );
+    c.set_line_key( line_key );
+    c.set_curve_key( curve_key );
+
+    std::vector<Device::unit_command> cmds( 50 );
+    for( std::size_t i = 0; i < cmds.size(); ++i )
+    {
+        cmds[i].type = i % 5 == 0 ? Device::CMD_MOVE : i % 5 == 4 ? Device::CMD_CURVE : Device::CMD_CUT;
+        for( int j = 0; j < 4; ++j )
+        {
+            cmds[i].pt[j] = ixy( i * 40 + j * 7, i * 13 - j * 3 );
+        }
+    }
+
+    Device::C::encoded_job job;
+    check( c.encode_job( &cmds[0], cmds.size(), job ) == cmds.size(), "encode_job" );
+    uint64_t hash = Device::job_cache::hash( &cmds[0], cmds.size(), c.key_id() );
+
+    //A saved job has to load back exactly
+    Device::C::encoded_job loaded;
+    uint64_t stored = 0;
+    check( Device::save_job( JOB_FILE, job, hash ), "save_job" );
+    check( Device::load_job( JOB_FILE, loaded, stored ), "load_job" );
+    check( stored == hash, "load_job hash" );
+    check( same_job( job, loaded ), "load_job contents" );
+
+    //Anything that is not a whole, consistent job is refused
+    std::vector<uint8_t> good = read_file( JOB_FILE );
+    std::size_t commands = job.ends.size();
+    std::size_t types    = 24 + commands * 12;
+    check( good.size() == types + job.frames.size() * ( 1 + sizeof( lmc_command ) ), "job file size" );
+    check_rejects( good, good.size(), 0, good.size() - 1, "truncated job" );
+    check_rejects( good, good.size(), 0, good.size() + 1, "job with trailing bytes" );
+    check_rejects( good, good.size(), 0, 10, "truncated header" );
+    check_rejects( good, 0, 'X', good.size(), "bad magic" );
+    check_rejects( good, 4, 2, good.size(), "bad version" );
+    check_rejects( good, 16, commands + 1, good.size(), "bad command count" );
+    check_rejects( good, 24, 0, good.size(), "first command owning no frames" );
+    check_rejects( good, 24 + 12, 1, good.size(), "frame ends going backwards" );
+    check_rejects( good, types, STAT_START, good.size(), "bad frame type" );
+    remove( JOB_FILE );
+    check( !Device::load_job( JOB_FILE, loaded, stored ), "missing job file" );
+
+    //A second cache on the same directory finds the job on disk
+    Device::job_cache first( 2, JOB_DIR );
+    const Device::C::encoded_job * cached = first.get( c, &cmds[0], cmds.size() );
+    check( cached != NULL && same_job( *cached, job ), "job_cache::get" );
+    Device::job_cache second( 2, JOB_DIR );
+    cached = second.get( c, &cmds[0], cmds.size() );
+    check( cached != NULL && same_job( *cached, job ), "job_cache::get from disk" );
+    check( second.get_stats().disk_hits == 1 && second.get_stats().misses == 0, "job_cache disk hit" );
+    remove( first.file_for( hash ).c_str() );
+
+    //A toolpath that cannot all be encoded is never stored
+    cmds[ 20 ].type = (Device::command_type)7;
+    uint64_t bad_hash = Device::job_cache::hash( &cmds[0], cmds.size(), c.key_id() );
+    check( first.get( c, &cmds[0], cmds.size() ) == NULL, "job_cache::get of a bad toolpath" );
+    check( first.find( bad_hash ) == NULL, "bad toolpath kept in memory" );
+    check( fopen( first.file_for( bad_hash ).c_str(), "rb" ) == NULL, "bad toolpath written to disk" );
+
+    if( failed > 0 )
+    {
+        cout << failed << " job cache checks failed" << endl;
+        return 1;
+    }
+    cout << "Hurray, you passed the job cache tests" << endl;
+    return 0;
+}